@@ -5,38 +5,183 @@ layout (location = 0) in vec4 a_position;
 layout (location = 1) in vec4 a_colour;
 layout (location = 2) in vec2 a_textureCoordinates;
 layout (location = 3) in float a_textureIndex;
+layout (location = 4) in float a_palette;
+layout (location = 5) in float a_camera;
+layout (location = 6) in float a_blendMode;
 
-uniform mat4 u_viewProjection;
+//rect (left, bottom, right, top) in normalized device coordinates the quad is clipped to, per draw under multi draw
+layout (location = 7) in vec4 a_clipRect;
+
+#define MAX_CAMERAS 8
+
+layout (std140, binding = 0) uniform Cameras {
+    mat4 u_viewProjections[MAX_CAMERAS];
+};
 
 layout (location = 0) out vec4 o_colour;
 layout (location = 1) out vec2 o_textureCoordinates;
 layout (location = 2) out flat float o_textureIndex;
+layout (location = 3) out flat float o_palette;
+layout (location = 4) out flat float o_blendMode;
+
+out float gl_ClipDistance[4];
+
+//clipping happens before rasterisation, so nothing has to discard fragments and early depth testing stays on
+void clipToRect(vec4 position) {
+    gl_ClipDistance[0] = position.x - a_clipRect.x * position.w;
+    gl_ClipDistance[1] = position.y - a_clipRect.y * position.w;
+    gl_ClipDistance[2] = a_clipRect.z * position.w - position.x;
+    gl_ClipDistance[3] = a_clipRect.w * position.w - position.y;
+}
+
+#ifdef VERTEX_PULLING
+//matches struct GPUSprite
+struct Sprite {
+    vec2 position;
+    vec2 size;
+    vec2 origin;
+    float rotation;
+    float layer;
+
+    vec4 uv;
+    uint colour;
+    uint camera;
+    uint blendMode;
+    float palette;
+};
+
+layout (std430, binding = 1) readonly buffer Sprites {
+    Sprite u_sprites[];
+};
 
+//how much nearer the renderer's batches have moved this frame, the records only hold their layer's z
+layout (location = 3) uniform float u_depthOffset;
+
+//two triangles per sprite over the corners top left, top right, bottom right, bottom left like the index buffer
+const int CORNERS[6] = int[6](0, 1, 2, 2, 3, 0);
+
+void main() {
+    Sprite sprite = u_sprites[gl_VertexID / 6];
+    int corner = CORNERS[gl_VertexID % 6];
+    bvec2 farSide = bvec2(corner == 1 || corner == 2, corner >= 2);
+
+    vec2 offset = (vec2(farSide) - sprite.origin) * sprite.size;
+    float sine = sin(sprite.rotation);
+    float cosine = cos(sprite.rotation);
+    vec2 position = sprite.position + vec2(offset.x * cosine - offset.y * sine, offset.x * sine + offset.y * cosine);
+
+    o_colour = unpackUnorm4x8(sprite.colour);
+    o_textureCoordinates = mix(sprite.uv.xy, sprite.uv.zw, vec2(farSide));
+    o_textureIndex = 0.0;
+    o_palette = sprite.palette;
+    o_blendMode = float(sprite.blendMode);
+
+    gl_Position = u_viewProjections[sprite.camera] * vec4(position, sprite.layer + u_depthOffset, 1.0);
+    clipToRect(gl_Position);
+}
+#else
 void main() {
     o_colour = a_colour;
     o_textureCoordinates = a_textureCoordinates;
     o_textureIndex = a_textureIndex;
+    o_palette = a_palette;
+    o_blendMode = a_blendMode;
 
-    gl_Position = u_viewProjection * a_position;
+    gl_Position = u_viewProjections[int(a_camera)] * a_position;
+    clipToRect(gl_Position);
 }
+#endif
 
 #FRAGMENT_SHADER
 #version 450 core
 
-#define MAX_TEXTURE_SLOTS 32
+#define MAX_TEXTURE_SLOTS 31
+#define PALETTE_SLOT 31
+#define PALETTE_SIZE 256
+
+//matches enum BlendMode
+#define BLEND_OPAQUE 0
+#define BLEND_CUTOUT 1
+#define BLEND_ALPHA 2
+#define BLEND_PREMULTIPLIED 3
+#define BLEND_ADDITIVE 4
+#define BLEND_MULTIPLY 5
 
 layout (location = 0) in vec4 a_colour;
 layout (location = 1) in vec2 a_textureCoordinates;
 layout (location = 2) in flat float a_textureIndex;
+layout (location = 3) in flat float a_palette;
+layout (location = 4) in flat float a_blendMode;
 
 layout (binding = 0) uniform sampler2D u_textures[MAX_TEXTURE_SLOTS];
+layout (binding = PALETTE_SLOT) uniform sampler2D u_palette;
+
+#ifdef SHARP_BILINEAR
+//texels of the target that were drawn this frame, the rest was cleared and must not blend in
+layout (location = 0) uniform vec2 u_usedSize;
+#endif
+
+#ifdef DEBUG
+//matches the debug views in opengl_renderer.c
+#define DEBUG_OVERDRAW 1
+#define DEBUG_TINT 2
+
+layout (location = 1) uniform int u_debugMode;
+layout (location = 2) uniform vec4 u_debugColour;
+#endif
 
 void main() {
     vec4 colour = a_colour;
 
     if (a_textureIndex >= 0 && a_textureIndex < MAX_TEXTURE_SLOTS) {
-        colour *= texture(u_textures[int(a_textureIndex)], a_textureCoordinates);
+        vec2 textureCoordinates = a_textureCoordinates;
+
+#ifdef SHARP_BILINEAR
+        //blend only across the last screen pixel of each texel, the rest of it is solid
+        vec2 size = vec2(textureSize(u_textures[int(a_textureIndex)], 0));
+        vec2 texelPosition = textureCoordinates * size;
+        vec2 pixelsPerTexel = 1.0 / fwidth(texelPosition);
+        vec2 region = 0.5 - 0.5 / pixelsPerTexel;
+        vec2 offset = fract(texelPosition) - 0.5;
+        vec2 samplePosition = floor(texelPosition) + 0.5 + (offset - clamp(offset, -region, region)) * pixelsPerTexel;
+        textureCoordinates = clamp(samplePosition, vec2(0.5), u_usedSize - 0.5) / size;
+#endif
+
+        vec4 texel = texture(u_textures[int(a_textureIndex)], textureCoordinates);
+
+        if (a_palette >= 0) {
+            int index = int(texel.r * (PALETTE_SIZE - 1.0) + 0.5);
+            texel = texelFetch(u_palette, ivec2(index, int(a_palette)), 0);
+        }
+
+        colour *= texel;
+    }
+
+    //cutouts are blended with the translucent quads rather than discarded in the opaque pass, a discard anywhere
+    //in the program would cost that pass its early depth test
+    int blendMode = int(a_blendMode);
+    if (blendMode == BLEND_CUTOUT) {
+        colour.a = step(0.5, colour.a);
+    }
+
+    //everything that blends is blended as premultiplied alpha, additive is premultiplied with no coverage
+    if (blendMode == BLEND_ALPHA || blendMode == BLEND_CUTOUT || blendMode == BLEND_ADDITIVE || blendMode == BLEND_MULTIPLY) {
+        colour.rgb *= colour.a;
+    }
+
+    if (blendMode == BLEND_ADDITIVE) {
+        colour.a = 0.0;
+    }
+
+#ifdef DEBUG
+    //overdraw adds up under premultiplied blending, zero alpha keeps what is already there
+    if (u_debugMode == DEBUG_OVERDRAW) {
+        colour = vec4(0.125, 0.04, 0.015, 0.0);
+    } else if (u_debugMode == DEBUG_TINT) {
+        float luminance = dot(colour.rgb, vec3(0.299, 0.587, 0.114));
+        colour.rgb = u_debugColour.rgb * (0.35 + 0.65 * luminance) * colour.a;
     }
+#endif
 
     gl_FragColor = colour;
 }
\ No newline at end of file
@@ -0,0 +1,211 @@
+#define SALAMANDER_ALLOC_TRACKER_IMPLEMENTATION
+#include "platform.h"
+
+#ifdef SALAMANDER_DEBUG
+
+#define ALLOC_TRACKER_MAX_SITES 512
+#define ALLOC_TRACKER_MAGIC 0x5A1A3A7Du
+
+//NOTE: sits in front of every tracked block so frees know their size and where they came from
+struct AllocationHeader {
+    u32 magic;
+    u32 site;
+    size_t size;
+};
+
+#define ALLOCATION_HEADER_SIZE ((sizeof(struct AllocationHeader) + 15) & ~(size_t)15)
+
+struct AllocationSite {
+    const char *file;
+    int line;
+    const char *kind;
+    
+    u64 allocationCount;
+    u64 frameAllocationCount;
+    u64 freeCount;
+    
+    size_t liveBytes;
+    size_t totalBytes;
+    size_t frameBytes;
+};
+
+struct AllocationTracker {
+    struct AllocationSite sites[ALLOC_TRACKER_MAX_SITES];
+    int siteCount;
+    
+    u64 frameIndex;
+    bool guard;
+    
+    //ticket lock, allocations come from the loader threads too
+    volatile i32 nextTicket;
+    volatile i32 nowServing;
+};
+
+static struct AllocationTracker g_tracker;
+
+static void lockTracker(void) {
+    i32 ticket = atomicAdd(&g_tracker.nextTicket, 1);
+    while (atomicAdd(&g_tracker.nowServing, 0) != ticket) {
+        //spin, the critical sections are tiny
+    }
+}
+
+static void unlockTracker(void) {
+    atomicAdd(&g_tracker.nowServing, 1);
+}
+
+//open addressing on the file pointer and line, __FILE__ is the same literal for every site in a translation unit
+static u32 getSiteIndex(const char *file, int line, const char *kind) {
+    u32 hash = (u32)(((uintptr_t)file >> 4) * 2654435761u) ^ (u32)(line * 40503u);
+    u32 index = hash % ALLOC_TRACKER_MAX_SITES;
+    
+    for (int i = 0; i < ALLOC_TRACKER_MAX_SITES; i++) {
+        struct AllocationSite *site = &g_tracker.sites[index];
+        
+        if (!site->file) {
+            site->file = file;
+            site->line = line;
+            site->kind = kind;
+            g_tracker.siteCount++;
+            return index;
+        }
+        
+        if (site->file == file && site->line == line) {
+            return index;
+        }
+        
+        index = (index + 1) % ALLOC_TRACKER_MAX_SITES;
+    }
+    
+    assert(!"out of allocation sites");
+    return 0;
+}
+
+static u32 recordAllocation(const char *file, int line, const char *kind, size_t size) {
+    lockTracker();
+    
+    u32 index = getSiteIndex(file, line, kind);
+    struct AllocationSite *site = &g_tracker.sites[index];
+    
+    site->allocationCount++;
+    site->frameAllocationCount++;
+    site->liveBytes += size;
+    site->totalBytes += size;
+    site->frameBytes += size;
+    
+    bool guard = g_tracker.guard;
+    
+    unlockTracker();
+    
+    if (guard) {
+        printf("ERROR %s allocation of %zu bytes at %s:%d inside the main loop!\n", kind, size, file, line);
+        assert(!"allocation inside the main loop");
+    }
+    
+    return index;
+}
+
+static void recordFree(u32 index, size_t size) {
+    lockTracker();
+    
+    struct AllocationSite *site = &g_tracker.sites[index];
+    site->freeCount++;
+    site->liveBytes -= size;
+    
+    unlockTracker();
+}
+
+static void *finishAllocation(struct AllocationHeader *header, size_t size, const char *file, int line) {
+    if (!header) return NULL;
+    
+    header->magic = ALLOC_TRACKER_MAGIC;
+    header->size = size;
+    header->site = recordAllocation(file, line, "heap", size);
+    
+    return (u8 *)header + ALLOCATION_HEADER_SIZE;
+}
+
+static struct AllocationHeader *getAllocationHeader(void *memory) {
+    struct AllocationHeader *header = (struct AllocationHeader *)((u8 *)memory - ALLOCATION_HEADER_SIZE);
+    assert(header->magic == ALLOC_TRACKER_MAGIC && "freeing memory that was not allocated through the tracker");
+    
+    return header;
+}
+
+void *trackedMalloc(size_t size, const char *file, int line) {
+    return finishAllocation(malloc(ALLOCATION_HEADER_SIZE + size), size, file, line);
+}
+
+void *trackedCalloc(size_t count, size_t size, const char *file, int line) {
+    return finishAllocation(calloc(1, ALLOCATION_HEADER_SIZE + count * size), count * size, file, line);
+}
+
+void *trackedRealloc(void *memory, size_t size, const char *file, int line) {
+    if (!memory) {
+        return trackedMalloc(size, file, line);
+    }
+    
+    struct AllocationHeader *header = getAllocationHeader(memory);
+    u32 oldSite = header->site;
+    size_t oldSize = header->size;
+    
+    header = realloc(header, ALLOCATION_HEADER_SIZE + size);
+    if (!header) return NULL;
+    
+    //counted as a free of the old block and a new allocation at this site
+    recordFree(oldSite, oldSize);
+    return finishAllocation(header, size, file, line);
+}
+
+void trackedFree(void *memory, const char *file, int line) {
+    if (!memory) return;
+    
+    struct AllocationHeader *header = getAllocationHeader(memory);
+    recordFree(header->site, header->size);
+    
+    header->magic = 0;
+    free(header);
+}
+
+void trackGPUAllocation(const char *kind, size_t size, const char *file, int line) {
+    recordAllocation(file, line, kind, size);
+}
+
+int endAllocationFrame(bool report) {
+    lockTracker();
+    
+    u64 frameAllocations = 0;
+    for (int i = 0; i < ALLOC_TRACKER_MAX_SITES; i++) {
+        frameAllocations += g_tracker.sites[i].frameAllocationCount;
+    }
+    
+    if (report && frameAllocations) {
+        printf("frame %llu: %llu allocations\n", (unsigned long long)g_tracker.frameIndex, (unsigned long long)frameAllocations);
+    }
+    
+    for (int i = 0; i < ALLOC_TRACKER_MAX_SITES; i++) {
+        struct AllocationSite *site = &g_tracker.sites[i];
+        
+        if (report && site->frameAllocationCount) {
+            printf("    %s:%d %s %llu allocations, %zu bytes (%zu live, %llu total)\n", site->file, site->line, site->kind,
+                   (unsigned long long)site->frameAllocationCount, site->frameBytes, site->liveBytes, (unsigned long long)site->allocationCount);
+        }
+        
+        site->frameAllocationCount = 0;
+        site->frameBytes = 0;
+    }
+    
+    g_tracker.frameIndex++;
+    
+    unlockTracker();
+    
+    return (int)frameAllocations;
+}
+
+void setAllocationGuard(bool enabled) {
+    lockTracker();
+    g_tracker.guard = enabled;
+    unlockTracker();
+}
+
+#endif
\ No newline at end of file
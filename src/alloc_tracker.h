@@ -0,0 +1,42 @@
+#ifndef SALAMANDER_ALLOC_TRACKER_H
+#define SALAMANDER_ALLOC_TRACKER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// debug only allocation tracking. every malloc/calloc/realloc/free made from our own code (stb included, it
+// goes through the image hooks) is counted per call site together with gpu buffer and texture storage
+#ifdef SALAMANDER_DEBUG
+
+void *trackedMalloc(size_t size, const char *file, int line);
+void *trackedCalloc(size_t count, size_t size, const char *file, int line);
+void *trackedRealloc(void *memory, size_t size, const char *file, int line);
+void trackedFree(void *memory, const char *file, int line);
+
+void trackGPUAllocation(const char *kind, size_t size, const char *file, int line);
+
+//closes the current frame, returns how many allocations it made and prints them per call site if asked to
+int endAllocationFrame(bool report);
+
+//NOTE: once enabled any tracked allocation fails an assert, turn this on after the main loop has warmed up
+void setAllocationGuard(bool enabled);
+
+#define TRACK_GPU_ALLOCATION(kind, size) trackGPUAllocation(kind, size, __FILE__, __LINE__)
+
+#ifndef SALAMANDER_ALLOC_TRACKER_IMPLEMENTATION
+#define malloc(size) trackedMalloc(size, __FILE__, __LINE__)
+#define calloc(count, size) trackedCalloc(count, size, __FILE__, __LINE__)
+#define realloc(memory, size) trackedRealloc(memory, size, __FILE__, __LINE__)
+#define free(memory) trackedFree(memory, __FILE__, __LINE__)
+#endif
+
+#else
+
+#define TRACK_GPU_ALLOCATION(kind, size)
+
+static inline int endAllocationFrame(bool report) { return 0; }
+static inline void setAllocationGuard(bool enabled) {}
+
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "arena.h"
+
+#define ALIGN_UP(value, alignment) (((value) + ((alignment) - 1)) & ~((size_t)(alignment) - 1))
+
+static size_t getBlockHeaderSize(void) {
+    return ALIGN_UP(sizeof(struct ArenaBlock), ARENA_ALIGNMENT);
+}
+
+static u8 *getBlockData(struct ArenaBlock *block) {
+    return (u8 *)block + getBlockHeaderSize();
+}
+
+static struct ArenaBlock *getArenaBlock(struct Arena *arena, size_t size) {
+    struct ArenaBlock **previous = &arena->spare;
+    
+    for (struct ArenaBlock *block = arena->spare; block; block = block->next) {
+        if (block->size >= size) {
+            *previous = block->next;
+            block->used = 0;
+            return block;
+        }
+        previous = &block->next;
+    }
+    
+    size_t blockSize = arena->blockSize ? arena->blockSize : ARENA_DEFAULT_BLOCK_SIZE;
+    if (size > blockSize) blockSize = size;
+    
+    struct ArenaBlock *block = malloc(getBlockHeaderSize() + blockSize);
+    if (!block) return NULL;
+    
+    block->size = blockSize;
+    block->used = 0;
+    
+    arena->heapAllocationCount++;
+    
+    return block;
+}
+
+void *arenaAlloc(struct Arena *arena, size_t size) {
+    size = ALIGN_UP(size, ARENA_ALIGNMENT);
+    
+    struct ArenaBlock *block = arena->current;
+    if (!block || block->used + size > block->size) {
+        block = getArenaBlock(arena, size);
+        if (!block) return NULL;
+        
+        block->next = arena->current;
+        arena->current = block;
+    }
+    
+    void *memory = getBlockData(block) + block->used;
+    block->used += size;
+    
+    arena->allocationCount++;
+    arena->bytesAllocated += size;
+    if (arena->bytesAllocated > arena->highWater) arena->highWater = arena->bytesAllocated;
+    
+    return memory;
+}
+
+void *arenaRealloc(struct Arena *arena, void *memory, size_t oldSize, size_t newSize) {
+    if (!memory) {
+        return arenaAlloc(arena, newSize);
+    }
+    
+    //growing the most recent allocation can happen in place
+    struct ArenaBlock *block = arena->current;
+    size_t alignedOld = ALIGN_UP(oldSize, ARENA_ALIGNMENT);
+    size_t alignedNew = ALIGN_UP(newSize, ARENA_ALIGNMENT);
+    
+    if (block && (u8 *)memory + alignedOld == getBlockData(block) + block->used && block->used - alignedOld + alignedNew <= block->size) {
+        block->used = block->used - alignedOld + alignedNew;
+        
+        arena->bytesAllocated = arena->bytesAllocated - alignedOld + alignedNew;
+        if (arena->bytesAllocated > arena->highWater) arena->highWater = arena->bytesAllocated;
+        
+        return memory;
+    }
+    
+    if (newSize <= oldSize) {
+        return memory;
+    }
+    
+    void *newMemory = arenaAlloc(arena, newSize);
+    if (newMemory) {
+        memcpy(newMemory, memory, oldSize);
+    }
+    
+    return newMemory;
+}
+
+bool arenaOwns(struct Arena *arena, void *memory) {
+    for (struct ArenaBlock *block = arena->current; block; block = block->next) {
+        u8 *data = getBlockData(block);
+        if ((u8 *)memory >= data && (u8 *)memory < data + block->size) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+struct ArenaMarker getArenaMarker(struct Arena *arena) {
+    struct ArenaMarker marker = { 0 };
+    
+    marker.block = arena->current;
+    marker.used = arena->current ? arena->current->used : 0;
+    marker.bytesAllocated = arena->bytesAllocated;
+    
+    return marker;
+}
+
+void resetArenaToMarker(struct Arena *arena, struct ArenaMarker marker) {
+    while (arena->current && arena->current != marker.block) {
+        struct ArenaBlock *block = arena->current;
+        arena->current = block->next;
+        
+        block->next = arena->spare;
+        arena->spare = block;
+    }
+    
+    if (arena->current) {
+        arena->current->used = marker.used;
+    }
+    
+    arena->bytesAllocated = marker.bytesAllocated;
+}
+
+void resetArena(struct Arena *arena) {
+    resetArenaToMarker(arena, (struct ArenaMarker) { 0 });
+    
+    arena->allocationCount = 0;
+    arena->heapAllocationCount = 0;
+}
+
+void freeArena(struct Arena *arena) {
+    resetArena(arena);
+    
+    struct ArenaBlock *block = arena->spare;
+    while (block) {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    
+    arena->spare = NULL;
+    arena->highWater = 0;
+}
\ No newline at end of file
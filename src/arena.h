@@ -0,0 +1,47 @@
+#ifndef SALAMANDER_ARENA_H
+#define SALAMANDER_ARENA_H
+
+#include "basic.h"
+
+#define ARENA_DEFAULT_BLOCK_SIZE (1024 * 1024)
+#define ARENA_ALIGNMENT 16
+
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+};
+
+//NOTE: allocations never move, a full block just chains a new one in front of it. resetting keeps the
+//blocks around as spares, so an arena that is reset every frame stops touching the heap once it has warmed up
+struct Arena {
+    struct ArenaBlock *current;
+    struct ArenaBlock *spare;
+    size_t blockSize;
+    
+    //counters since the last reset
+    u32 allocationCount;
+    u32 heapAllocationCount;
+    size_t bytesAllocated;
+    
+    size_t highWater;
+};
+
+struct ArenaMarker {
+    struct ArenaBlock *block;
+    size_t used;
+    size_t bytesAllocated;
+};
+
+void *arenaAlloc(struct Arena *arena, size_t size);
+void *arenaRealloc(struct Arena *arena, void *memory, size_t oldSize, size_t newSize);
+bool arenaOwns(struct Arena *arena, void *memory);
+
+// scoped scratch memory, everything allocated after the marker is given back at once
+struct ArenaMarker getArenaMarker(struct Arena *arena);
+void resetArenaToMarker(struct Arena *arena, struct ArenaMarker marker);
+
+void resetArena(struct Arena *arena);
+void freeArena(struct Arena *arena);
+
+#endif
\ No newline at end of file
@@ -17,10 +17,15 @@ typedef int64_t i64;
 typedef float f32;
 typedef double f64;
 
-//TODO: get a more accurate approximation of pi
-#define PI 3.14159265359
+#define PI 3.14159265358979323846
 #define DEGREES_TO_RADIANS(d) ((d)*(PI / 180))
 
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,4 +33,6 @@ typedef double f64;
 
 #include <cglm/cglm.h>
 
+#include "alloc_tracker.h"
+
 #endif
\ No newline at end of file
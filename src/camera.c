@@ -0,0 +1,46 @@
+#include "camera.h"
+
+struct Camera createCamera(float left, float right, float top, float bottom) {
+    struct Camera camera = { 0 };
+    camera.zoom = 1.0f;
+    
+    setCameraProjection(&camera, left, right, top, bottom);
+    updateCamera(&camera);
+    
+    return camera;
+}
+
+void setCameraProjection(struct Camera *camera, float left, float right, float top, float bottom) {
+    glm_ortho(left, right, bottom, top, -1.0f, 1.0f, camera->projectionMatrix);
+    camera->dirty = true;
+}
+
+bool updateCamera(struct Camera *camera) {
+    bool changed = camera->dirty ||
+        camera->position[0] != camera->builtPosition[0] || camera->position[1] != camera->builtPosition[1] ||
+        camera->rotation != camera->builtRotation || camera->zoom != camera->builtZoom;
+    
+    if (!changed) return false;
+    
+    //scale, rotate then move opposite to the camera, built directly rather than inverting a view matrix
+    float radians = (float)DEGREES_TO_RADIANS(camera->rotation);
+    float c = cosf(radians) * camera->zoom;
+    float s = sinf(radians) * camera->zoom;
+    
+    mat4 view = {
+        {  c,    s,    0.0f, 0.0f },
+        { -s,    c,    0.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f, 0.0f },
+        { -camera->position[0], -camera->position[1], 0.0f, 1.0f },
+    };
+    
+    glm_mat4_mul(camera->projectionMatrix, view, camera->viewProjectionMatrix);
+    
+    camera->builtPosition[0] = camera->position[0];
+    camera->builtPosition[1] = camera->position[1];
+    camera->builtRotation = camera->rotation;
+    camera->builtZoom = camera->zoom;
+    camera->dirty = false;
+    
+    return true;
+}
\ No newline at end of file
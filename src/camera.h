@@ -0,0 +1,28 @@
+#ifndef SALAMANDER_CAMERA_H
+#define SALAMANDER_CAMERA_H
+
+#include "basic.h"
+
+//the fields can be written directly, updateCamera compares them against what the matrices were last built from
+struct Camera {
+    vec2 position;
+    
+    float rotation;
+    float zoom;
+    
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    
+    vec2 builtPosition;
+    float builtRotation;
+    float builtZoom;
+    bool dirty;
+};
+
+struct Camera createCamera(float left, float right, float top, float bottom);
+void setCameraProjection(struct Camera *camera, float left, float right, float top, float bottom);
+
+//rebuilds viewProjectionMatrix if anything changed, returns whether it did
+bool updateCamera(struct Camera *camera);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "fast_math.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FAST_MATH_SSE2
+#include <emmintrin.h>
+#endif
+
+//pi / 2 split in three so the range reduction stays exact for larger angles
+#define HALF_PI_1 1.5703125f
+#define HALF_PI_2 4.837512969970703125e-4f
+#define HALF_PI_3 7.54978995489188216e-8f
+#define TWO_OVER_PI 0.636619772367581343f
+
+//minimax polynomials on [-pi/4, pi/4]
+#define SIN_C0 -1.6666654611e-1f
+#define SIN_C1 8.3321608736e-3f
+#define SIN_C2 -1.9515295891e-4f
+
+#define COS_C0 4.166664568298827e-2f
+#define COS_C1 -1.388731625493765e-3f
+#define COS_C2 2.443315711809948e-5f
+
+static void sinCosScalar(float angle, float *sine, float *cosine) {
+    //reduce to r in [-pi/4, pi/4] and the quadrant it came from
+    int quadrant = (int)lrintf(angle * TWO_OVER_PI);
+    float q = (float)quadrant;
+    float r = ((angle - q * HALF_PI_1) - q * HALF_PI_2) - q * HALF_PI_3;
+    float r2 = r * r;
+    
+    float s = r + r * r2 * (SIN_C0 + r2 * (SIN_C1 + r2 * SIN_C2));
+    float c = 1.0f - 0.5f * r2 + r2 * r2 * (COS_C0 + r2 * (COS_C1 + r2 * COS_C2));
+    
+    switch (quadrant & 3) {
+        case 0: *sine = s; *cosine = c; break;
+        case 1: *sine = c; *cosine = -s; break;
+        case 2: *sine = -s; *cosine = -c; break;
+        case 3: *sine = -c; *cosine = s; break;
+    }
+}
+
+void sinCosBulk(float *angles, float *sines, float *cosines, int count) {
+    int i = 0;
+    
+#ifdef FAST_MATH_SSE2
+    const __m128 twoOverPi = _mm_set1_ps(TWO_OVER_PI);
+    const __m128 halfPi1 = _mm_set1_ps(HALF_PI_1);
+    const __m128 halfPi2 = _mm_set1_ps(HALF_PI_2);
+    const __m128 halfPi3 = _mm_set1_ps(HALF_PI_3);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    
+    for (; i + 4 <= count; i += 4) {
+        __m128 angle = _mm_loadu_ps(angles + i);
+        
+        //rounds to nearest under the default mxcsr
+        __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(angle, twoOverPi));
+        __m128 q = _mm_cvtepi32_ps(quadrant);
+        
+        __m128 r = _mm_sub_ps(angle, _mm_mul_ps(q, halfPi1));
+        r = _mm_sub_ps(r, _mm_mul_ps(q, halfPi2));
+        r = _mm_sub_ps(r, _mm_mul_ps(q, halfPi3));
+        __m128 r2 = _mm_mul_ps(r, r);
+        
+        __m128 s = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(SIN_C2)), _mm_set1_ps(SIN_C1));
+        s = _mm_add_ps(_mm_mul_ps(r2, s), _mm_set1_ps(SIN_C0));
+        s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+        
+        __m128 c = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(COS_C2)), _mm_set1_ps(COS_C1));
+        c = _mm_add_ps(_mm_mul_ps(r2, c), _mm_set1_ps(COS_C0));
+        c = _mm_mul_ps(_mm_mul_ps(r2, r2), c);
+        c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), c);
+        
+        //odd quadrants swap sine and cosine, bit 1 of the quadrant (and of quadrant + 1 for cosine) flips the sign
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+        __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+        __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+        
+        __m128 sine = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+        __m128 cosine = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+        
+        _mm_storeu_ps(sines + i, _mm_xor_ps(sine, sineSign));
+        _mm_storeu_ps(cosines + i, _mm_xor_ps(cosine, cosineSign));
+    }
+#endif
+    
+    for (; i < count; i++) {
+        sinCosScalar(angles[i], &sines[i], &cosines[i]);
+    }
+}
\ No newline at end of file
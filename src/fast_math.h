@@ -0,0 +1,10 @@
+#ifndef SALAMANDER_FAST_MATH_H
+#define SALAMANDER_FAST_MATH_H
+
+#include "basic.h"
+
+//sines and cosines of many angles (radians) at once, four per iteration with sse2. accurate to a couple of
+//ulp for angles within a few thousand radians of zero, which is plenty for sprite rotations
+void sinCosBulk(float *angles, float *sines, float *cosines, int count);
+
+#endif
\ No newline at end of file
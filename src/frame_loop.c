@@ -0,0 +1,100 @@
+#include "platform.h"
+#include "profiler.h"
+
+#define FRAME_INITIAL_SPIN_MARGIN 0.002
+#define FRAME_MIN_SPIN_MARGIN 0.0002
+#define FRAME_MAX_SPIN_MARGIN 0.004
+
+void createFrameLoop(struct FrameLoop *loop, double fixedStep, double targetFrameRate) {
+    memset(loop, 0, sizeof(struct FrameLoop));
+    
+    loop->fixedStep = fixedStep;
+    loop->targetFrameTime = (targetFrameRate > 0.0) ? 1.0 / targetFrameRate : 0.0;
+    loop->spinMargin = FRAME_INITIAL_SPIN_MARGIN;
+    loop->timestampFrequency = getTimestampFrequency();
+    
+    loop->frameStart = getTimestamp();
+    loop->stepTimestamp = loop->frameStart;
+}
+
+void beginFrame(struct FrameLoop *loop) {
+    u64 now = getTimestamp();
+    double frameTime = getSecondsBetween(loop->frameStart, now);
+    loop->frameStart = now;
+    
+    //after a hitch (breakpoint, window drag) drop the time we can not catch up on instead of spiralling
+    loop->accumulator += frameTime;
+    if (loop->accumulator > loop->fixedStep * FRAME_MAX_STEPS) {
+        loop->accumulator = loop->fixedStep * FRAME_MAX_STEPS;
+    }
+    
+    loop->stepsThisFrame = 0;
+    
+    struct FrameStats *stats = &loop->stats;
+    stats->frameTime = frameTime;
+    loop->samples[stats->frameCount % FRAME_STATS_WINDOW] = (float)frameTime;
+    stats->frameCount++;
+    
+    u64 sampleCount = (stats->frameCount < FRAME_STATS_WINDOW) ? stats->frameCount : FRAME_STATS_WINDOW;
+    double total = 0.0;
+    stats->minFrameTime = loop->samples[0];
+    stats->maxFrameTime = loop->samples[0];
+    
+    for (u64 i = 0; i < sampleCount; i++) {
+        double sample = loop->samples[i];
+        total += sample;
+        
+        if (sample < stats->minFrameTime) stats->minFrameTime = sample;
+        if (sample > stats->maxFrameTime) stats->maxFrameTime = sample;
+    }
+    stats->averageFrameTime = total / (double)sampleCount;
+}
+
+bool stepFrame(struct FrameLoop *loop) {
+    if (loop->accumulator >= loop->fixedStep) {
+        loop->accumulator -= loop->fixedStep;
+        loop->stepsThisFrame++;
+        
+        //the last step of a frame takes everything polled so far, otherwise input landing in the leftover
+        //fraction of a step would sit out a whole frame
+        if (loop->accumulator >= loop->fixedStep) {
+            loop->stepTimestamp = loop->frameStart - (u64)(loop->accumulator * (double)loop->timestampFrequency);
+        } else {
+            loop->stepTimestamp = loop->frameStart;
+        }
+        return true;
+    }
+    
+    loop->alpha = (float)(loop->accumulator / loop->fixedStep);
+    return false;
+}
+
+void endFrame(struct FrameLoop *loop) {
+    if (loop->targetFrameTime <= 0.0) return;
+    
+    PROFILE_BEGIN("frameLimiter");
+    
+    u64 frameEnd = loop->frameStart + (u64)(loop->targetFrameTime * (double)loop->timestampFrequency);
+    
+    //sleep through most of what is left, then spin the last stretch so the wake up lands on time
+    double remaining = getSecondsBetween(getTimestamp(), frameEnd);
+    double sleepTime = remaining - loop->spinMargin;
+    
+    if (sleepTime > 0.0) {
+        u64 sleepStart = getTimestamp();
+        sleepFor(sleepTime);
+        double overslept = getSecondsBetween(sleepStart, getTimestamp()) - sleepTime;
+        
+        //grow the margin straight away when the os is late, shrink it slowly when it is not
+        double margin = loop->spinMargin * 0.95;
+        if (overslept * 1.25 > margin) margin = overslept * 1.25;
+        
+        if (margin < FRAME_MIN_SPIN_MARGIN) margin = FRAME_MIN_SPIN_MARGIN;
+        if (margin > FRAME_MAX_SPIN_MARGIN) margin = FRAME_MAX_SPIN_MARGIN;
+        loop->spinMargin = margin;
+    }
+    
+    while (getSecondsBetween(getTimestamp(), frameEnd) > 0.0);
+    
+    PROFILE_END();
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "platform.h"
+#include "profiler.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,49 +11,144 @@ static void windowClosedCallback(GLFWwindow *window) {
     platform->windowClosed = true;
 }
 
+//NOTE: glfw does not hand us the os event time, so events are stamped when the callback runs inside glfwPollEvents
+static void pushInputEvent(struct Platform *platform, struct InputEvent event) {
+    struct InputQueue *queue = &platform->inputQueue;
+    
+    u32 write = (u32)queue->writeIndex;
+    u32 read = (u32)atomicLoad(&queue->readIndex);
+    
+    if (write - read >= INPUT_QUEUE_SIZE) {
+        queue->droppedCount++;
+        return;
+    }
+    
+    event.timestamp = getTimestamp();
+    queue->events[write % INPUT_QUEUE_SIZE] = event;
+    atomicStore(&queue->writeIndex, (i32)(write + 1));
+}
+
 static void windowKeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
     struct Platform *platform = glfwGetWindowUserPointer(window);
     
-    bool isDown = (action == GLFW_PRESS) || (action == GLFW_REPEAT);
-    bool wasDown = (action == GLFW_RELEASE) || (action == GLFW_REPEAT);
-    
     if (key >= 0 && key < INPUT_KEY_BUFFER_SIZE) {
-        bool isPressed = isDown && !wasDown;
-        bool isReleased = !isDown && wasDown;
-        
-        u8 state = 0;
-        state = (state | isPressed) << 1;
-        state = (state | isReleased) << 1;
-        state |= isDown;
+        struct InputEvent event = { 0 };
+        event.type = (action == GLFW_RELEASE) ? INPUT_KEY_UP : INPUT_KEY_DOWN;
+        event.repeat = (action == GLFW_REPEAT);
+        event.code = (u16)key;
         
-        platform->keyState[key] = state;
+        pushInputEvent(platform, event);
     }
 }
 
 static void windowMousePosCallback(GLFWwindow *window, double xpos, double ypos) {
     struct Platform *platform = glfwGetWindowUserPointer(window);
     
-    platform->mouseX = (float)xpos;
-    platform->mouseY = (float)ypos;
+    struct InputEvent event = { 0 };
+    event.type = INPUT_MOUSE_MOVE;
+    event.mouseX = (float)xpos;
+    event.mouseY = (float)ypos;
+    
+    pushInputEvent(platform, event);
 }
 
 static void windowMouseButtonCallback(GLFWwindow *window, int button, int action, int mods) {
     struct Platform *platform = glfwGetWindowUserPointer(window);
     
-    bool isDown = (action == GLFW_PRESS);
-    bool wasDown = (action == GLFW_RELEASE) || (action == GLFW_REPEAT);
-    
     if (button >= 0 && button < INPUT_BUTTON_BUFFER_SIZE) {
-        bool isPressed = isDown && !wasDown;
-        bool isReleased = !isDown && wasDown;
+        struct InputEvent event = { 0 };
+        event.type = (action == GLFW_PRESS) ? INPUT_BUTTON_DOWN : INPUT_BUTTON_UP;
+        event.code = (u16)button;
         
-        u8 state = 0;
-        state = (state | isPressed) << 1;
-        state = (state | isReleased) << 1;
-        state |= isDown;
+        pushInputEvent(platform, event);
+    }
+}
+
+//returns true the first time a pressed or released bit is set, which is when the key needs clearing later
+static bool applyInputState(u8 *state, bool isDown) {
+    bool wasDown = *state & 0b0001;
+    bool hadTransient = *state & 0b0110;
+    
+    if (isDown && !wasDown) *state |= 0b0100;
+    if (!isDown && wasDown) *state |= 0b0010;
+    *state = (*state & ~0b0001) | isDown;
+    
+    return !hadTransient && (*state & 0b0110);
+}
+
+void processInput(struct Platform *platform, u64 until) {
+    for (int i = 0; i < platform->changedKeyCount; i++) {
+        platform->keyState[platform->changedKeys[i]] &= 0b0001;
+    }
+    platform->changedKeyCount = 0;
+    
+    for (int i = 0; i < platform->changedButtonCount; i++) {
+        platform->buttonState[platform->changedButtons[i]] &= 0b0001;
+    }
+    platform->changedButtonCount = 0;
+    
+    platform->inputEventCount = 0;
+    
+    struct InputQueue *queue = &platform->inputQueue;
+    u32 read = (u32)queue->readIndex;
+    u32 write = (u32)atomicLoad(&queue->writeIndex);
+    
+    for (; read != write; read++) {
+        struct InputEvent *event = &queue->events[read % INPUT_QUEUE_SIZE];
+        if (event->timestamp > until) break;
         
-        platform->buttonState[button] = state;
+        switch (event->type) {
+            case INPUT_KEY_DOWN:
+            case INPUT_KEY_UP: {
+                if (applyInputState(&platform->keyState[event->code], event->type == INPUT_KEY_DOWN)) {
+                    platform->changedKeys[platform->changedKeyCount++] = (u8)event->code;
+                }
+            } break;
+            
+            case INPUT_BUTTON_DOWN:
+            case INPUT_BUTTON_UP: {
+                if (applyInputState(&platform->buttonState[event->code], event->type == INPUT_BUTTON_DOWN)) {
+                    platform->changedButtons[platform->changedButtonCount++] = (u8)event->code;
+                }
+            } break;
+            
+            case INPUT_MOUSE_MOVE: {
+                platform->mouseX = event->mouseX;
+                platform->mouseY = event->mouseY;
+            } break;
+        }
+        
+        if (event->type != INPUT_MOUSE_MOVE && !event->repeat && !platform->oldestUnpresentedInput) {
+            platform->oldestUnpresentedInput = event->timestamp;
+        }
+        
+        platform->inputEvents[platform->inputEventCount++] = *event;
     }
+    
+    atomicStore(&queue->readIndex, (i32)read);
+}
+
+void latchInput(struct Platform *platform) {
+    PROFILE_BEGIN("latchInput");
+    glfwPollEvents();
+    
+    for (int i = 0; i < INPUT_KEY_BUFFER_SIZE; i++) {
+        platform->latchedKeyDown[i] = platform->keyState[i] & 0b0001;
+    }
+    
+    //the events stay queued, the next simulation step still sees every one of them
+    struct InputQueue *queue = &platform->inputQueue;
+    u32 write = (u32)atomicLoad(&queue->writeIndex);
+    
+    for (u32 read = (u32)queue->readIndex; read != write; read++) {
+        struct InputEvent *event = &queue->events[read % INPUT_QUEUE_SIZE];
+        
+        if (event->type == INPUT_KEY_DOWN || event->type == INPUT_KEY_UP) {
+            platform->latchedKeyDown[event->code] = (event->type == INPUT_KEY_DOWN);
+        }
+    }
+    
+    PROFILE_END();
 }
 
 //TODO: do we want these functions to access global data?
@@ -148,65 +244,29 @@ struct Platform *createPlatform(char *title, int width, int height) {
     return platform;
 }
 
-void updatePlatform(struct Platform *platform) {
-    for (int i = 0; i < INPUT_KEY_BUFFER_SIZE; i++) {
-        platform->keyState[i] &= 0b0001;
+void setSwapInterval(struct Platform *platform, int interval) {
+    //adaptive vsync needs the tear extension, without it the closest thing is plain vsync
+    if (interval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+        interval = 1;
     }
     
-    for (int i = 0; i < INPUT_BUTTON_BUFFER_SIZE; i++) {
-        platform->buttonState[i] &= 0b0001;
-    }
-    
-    glfwSwapBuffers(platform->nativeWindow);
-    glfwPollEvents();
-}
-
-//TODO: these dont belong here
-Buffer readFileIntoBuffer(char *path) {
-    Buffer file = { 0 };
-    
-    FILE *handle;
-    fopen_s(&handle, path, "r");
-    
-    fseek(handle, 0, SEEK_END);
-    file.size = ftell(handle);
-    fseek(handle, 0, SEEK_SET);
-    
-    file.data = malloc(file.size + 1);
-    memset(file.data, 0, file.size + 1);
-    
-    size_t bytesRead = fread_s(file.data, file.size, sizeof(u8), file.size, handle);
-    file.data[bytesRead] = '\0';
-    
-    fclose(handle);
-    
-    return file;
+    glfwSwapInterval(interval);
 }
 
-int findLineInBuffer(Buffer buffer, char *line) {
-    const int tempBufferSize = 1024;
-    
-    char temp[1024] = { 0 };
-    int lastOffset = 0;
-    
-    while (true) {
-        int offset = 0;
-        char *current = buffer.data + lastOffset;
-        
-        while (current[offset] != '\n' && current[offset] != '\0') {
-            offset++;
-        }
+void updatePlatform(struct Platform *platform) {
+    if (!platform->skipSwap) {
+        PROFILE_BEGIN("glfwSwapBuffers");
+        glfwSwapBuffers(platform->nativeWindow);
+        PROFILE_END();
         
-        memcpy_s(temp, tempBufferSize, current, offset);
-        if (strncmp(temp, line, strnlen(line, tempBufferSize)) == 0) {
-            return lastOffset;
+        if (platform->oldestUnpresentedInput) {
+            platform->inputLatency = getSecondsBetween(platform->oldestUnpresentedInput, getTimestamp());
+            platform->oldestUnpresentedInput = 0;
         }
-        memset(temp, 0, tempBufferSize);
-        
-        if (current[offset] == '\0') break;
-        
-        lastOffset += ++offset;
     }
+    platform->skipSwap = false;
     
-    return -1;
+    PROFILE_BEGIN("glfwPollEvents");
+    glfwPollEvents();
+    PROFILE_END();
 }
\ No newline at end of file
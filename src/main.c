@@ -1,82 +1,307 @@
 #include "platform.h"
 #include "renderer.h"
+#include "camera.h"
+#include "profiler.h"
 
-struct Camera {
-    vec2 position;
-    
-    float rotation;
-    float zoom;
-    
-    mat4 projectionMatrix;
-    mat4 viewMatrix;
-};
+#define ALLOCATION_WARMUP_FRAMES 3
+
+#define SIMULATION_STEP (1.0 / 120.0)
+
+//the world is drawn at its art's resolution and scaled up to the window
+#define PIXEL_SCALE 3
+
+//gpu seconds the world pass may take before its resolution drops, half of a 60hz frame
+#define WORLD_GPU_BUDGET (0.5 / 60.0)
+#define WORLD_MIN_SCALE 0.5f
+
+//units per second
+#define CAMERA_SPEED 50.0f
+#define CAMERA_ZOOM_SPEED 0.25f
+#define CAMERA_ROTATION_SPEED 45.0f
 
-void setProjection(struct Camera *camera, float left, float right, float top, float bottom) {
-    glm_ortho(left, right, bottom, top, -1.0f, 1.0f, camera->projectionMatrix);
+//radians per second
+#define SPIN_SPEED 1.5f
+
+//renderer camera slots
+#define WORLD_CAMERA 0
+#define HUD_CAMERA 1
+#define PANEL_CAMERA 2
+
+#define PANEL_SIZE 128.0f
+
+//sprites per side of the field kept in a sprite buffer, and the world units between them
+#define FIELD_SIZE 256
+#define FIELD_SPACING 6.0f
+
+static bool isCameraKeyDown(struct Platform *platform, int key, bool latched) {
+    return latched ? platform->latchedKeyDown[key] : platform->isKeyDown(key);
 }
 
-void setViewProjection(struct Shader shader, struct Camera *camera) {
-    glm_mat4_identity(camera->viewMatrix);
-    glm_translate(camera->viewMatrix, (vec3){ camera->position[0], camera->position[1], 0.0f });
-    
-    mat4 inverseView;
-    glm_mat4_inv(camera->viewMatrix, inverseView);
+void moveCamera(struct Camera *camera, struct Platform *platform, bool latched, float dt) {
+    if (isCameraKeyDown(platform, 'D', latched)) camera->position[0] += CAMERA_SPEED * dt;
+    if (isCameraKeyDown(platform, 'A', latched)) camera->position[0] -= CAMERA_SPEED * dt;
     
-    glm_rotate(inverseView, DEGREES_TO_RADIANS(camera->rotation), (vec3){ 0.0f, 0.0f, 1.0f });
-    glm_scale(inverseView, (vec3){ camera->zoom, camera->zoom, 0.0f });
+    if (isCameraKeyDown(platform, 'S', latched)) camera->position[1] += CAMERA_SPEED * dt;
+    if (isCameraKeyDown(platform, 'W', latched)) camera->position[1] -= CAMERA_SPEED * dt;
     
-    mat4 vp;
-    glm_mat4_mul(camera->projectionMatrix, inverseView, vp);
+    if (isCameraKeyDown(platform, 'Z', latched)) camera->zoom += CAMERA_ZOOM_SPEED * dt;
+    if (isCameraKeyDown(platform, 'X', latched) && camera->zoom > 0.0f) camera->zoom -= CAMERA_ZOOM_SPEED * dt;
     
-    setShaderMat4(shader, "u_viewProjection", vp);
+    if (isCameraKeyDown(platform, 'R', latched)) camera->rotation += CAMERA_ROTATION_SPEED * dt;
+    if (isCameraKeyDown(platform, 'E', latched)) camera->rotation -= CAMERA_ROTATION_SPEED * dt;
 }
 
 int main(int argc, char **argv) {
+    setProfileThreadName("main");
+    
     struct Platform *platform = createPlatform("SALAMANDER", 1280, 720);
-    struct Renderer *renderer = createRenderer(100);
+    //everything that lives as long as the level does
+    struct Arena levelArena = { 0 };
+    
+    struct Renderer *renderer = createRenderer(&levelArena, 100);
+    
+    //shaders compile in the background while the textures below are decoded
+    struct Shader shader;
+    struct ShaderBatch *shaderBatch = beginShaderBatch();
+    addShaderToBatch(shaderBatch, "C:\\dev\\Salamander\\data\\default.glsl", &shader);
+    
+    int worldWidth = platform->windowWidth / PIXEL_SCALE;
+    int worldHeight = platform->windowHeight / PIXEL_SCALE;
+    struct Camera camera = createCamera(0.0f, (float)worldWidth, 0.0f, (float)worldHeight);
+    
+    //the hud never moves, its matrix is uploaded once
+    struct Camera hudCamera = createCamera(0.0f, platform->windowWidth, 0.0f, platform->windowHeight);
+    setRendererCamera(renderer, HUD_CAMERA, hudCamera.viewProjectionMatrix);
+    
+    char *texturePaths[] = {
+        "C:\\dev\\Salamander\\data\\test.png",
+        "C:\\dev\\Salamander\\data\\test2.png",
+    };
+    
+    //zooming out shrinks sprites well below their native size, so sample from a mip chain
+    struct Texture textures[2];
+    loadTextures(texturePaths, textures, 2, MIPMAPPED_TEXTURE_SETTINGS);
+    
+    struct Texture texture = textures[0];
+    struct Texture texture2 = textures[1];
+    
+    finishShaderBatch(shaderBatch);
+    
+    //B cycles the debug views, the variant is compiled now so switching never allocates
+    struct ShaderTemplate *shaderTemplate = loadShaderTemplate("C:\\dev\\Salamander\\data\\default.glsl");
+    struct Shader debugShader = getShaderVariant(shaderTemplate, "DEBUG");
+    enum RendererDebugMode debugMode = RENDERER_DEBUG_NONE;
     
-    struct Shader shader = loadShader("C:\\dev\\Salamander\\data\\default.glsl");
+    //the panel is composed once and drawn as a single quad from then on
+    struct RenderTarget panel = createRenderTarget((int)PANEL_SIZE, (int)PANEL_SIZE, DEFAULT_TEXTURE_SETTINGS);
+    struct Camera panelCamera = createCamera(0.0f, PANEL_SIZE, 0.0f, PANEL_SIZE);
+    setRendererCamera(renderer, PANEL_CAMERA, panelCamera.viewProjectionMatrix);
     
-    struct Camera camera = { 0 };
-    camera.zoom = 1.0f;
+    setRendererShader(renderer, shader);
+    useRendererCamera(renderer, PANEL_CAMERA);
+    beginRenderTarget(renderer, &panel, (vec4){ 0.08f, 0.08f, 0.12f, 0.8f });
+    drawTexture(renderer, texture, (vec2){ 8.0f, 8.0f }, (vec2){ 1.0f, 1.0f });
+    drawTextureEx(renderer, texture2, (vec2){ 96.0f, 96.0f }, (vec2){ 1.0f, 1.0f }, (vec2){ 0.5f, 0.5f }, 0.3f,
+                  FULL_SOURCE_RECT, SPRITE_FLIP_NONE);
+    endRenderTarget(renderer);
     
-    setProjection(&camera, 0.0f, platform->windowWidth, 0.0f, platform->windowHeight);
+    //N switches the upscale between nearest and sharp bilinear
+    struct RenderTarget worldTarget = createRenderTarget(worldWidth, worldHeight, DEFAULT_TEXTURE_SETTINGS);
+    struct Shader sharpBilinearShader = getShaderVariant(shaderTemplate, "SHARP_BILINEAR");
+    enum UpscaleFilter upscaleFilter = UPSCALE_NEAREST;
     
-    vec2 renderScale = { 3.0f, 3.0f };
+    //the world pass gives up resolution when the gpu cannot fill it in time, the hud stays at native resolution
+    struct GPUTimer worldTimer = createGPUTimer();
+    struct ResolutionController worldResolution = createResolutionController(WORLD_GPU_BUDGET, WORLD_MIN_SCALE, 1.0f);
+    double worldGPUTime = 0.0;
+    float worldGPUScale = 1.0f;
     
-    vec2 position = { 100.0f, 100.0f };
-    float speed = 0.25f;
+    //M toggles multi draw
+    createRendererMultiDraw(renderer, &levelArena, 4096, 256);
+    bool multiDraw = false;
     
-    struct Texture texture = loadTexture("C:\\dev\\Salamander\\data\\test.png");
-    struct Texture texture2 = loadTexture("C:\\dev\\Salamander\\data\\test2.png");
+    //C toggles partial redraw
+    createRendererFrameCache(renderer, &levelArena, platform->windowWidth, platform->windowHeight, 1024);
+    bool partialRedraw = false;
+    
+    //the field is written once and every frame draws it straight from the gpu copy with nothing uploaded
+    struct Shader vertexPullingShader = getShaderVariant(shaderTemplate, "VERTEX_PULLING");
+    struct Shader vertexPullingDebugShader = getShaderVariant(shaderTemplate, "VERTEX_PULLING DEBUG");
+    struct SpriteBuffer field = createSpriteBuffer(&levelArena, texture2, FIELD_SIZE * FIELD_SIZE);
+    
+    useRendererCamera(renderer, WORLD_CAMERA);
+    for (int y = 0; y < FIELD_SIZE; y++) {
+        for (int x = 0; x < FIELD_SIZE; x++) {
+            struct Sprite sprite = { 0 };
+            sprite.position[0] = x * FIELD_SPACING;
+            sprite.position[1] = y * FIELD_SPACING;
+            sprite.scale[0] = 0.125f;
+            sprite.scale[1] = 0.125f;
+            sprite.origin[0] = 0.5f;
+            sprite.origin[1] = 0.5f;
+            sprite.rotation = (x + y) * 0.4f;
+            glm_vec4_copy(FULL_SOURCE_RECT, sprite.sourceRect);
+            
+            setSprite(renderer, &field, y * FIELD_SIZE + x, &sprite);
+        }
+    }
+    
+    //vsync paces the loop, pass a frame rate to createFrameLoop when running with a swap interval of 0
+    setSwapInterval(platform, 1);
+    
+    struct FrameLoop loop;
+    createFrameLoop(&loop, SIMULATION_STEP, 0.0);
+    
+    struct Camera previousCamera = camera;
+    struct Camera renderCamera = camera;
+    setRendererCamera(renderer, WORLD_CAMERA, renderCamera.viewProjectionMatrix);
+    
+    //L toggles late latching, the camera is rebuilt from input polled right before the flush
+    bool lateLatch = false;
+    
+    struct RendererStats renderStats = { 0 };
+    
+    float spin = 0.0f;
+    float previousSpin = spin;
+    
+    int frameCount = 0;
     
     while (!platform->windowClosed) {
-        printf("%f\n", camera.zoom);
+        PROFILE_BEGIN("frame");
+        beginFrame(&loop);
         
-        if (platform->isKeyDown('D')) camera.position[0] += speed;
-        if (platform->isKeyDown('A')) camera.position[0] -= speed;
+        while (stepFrame(&loop)) {
+            float dt = (float)loop.fixedStep;
+            previousCamera = camera;
+            previousSpin = spin;
+            
+            //each step only sees the input that happened before the time it simulates
+            processInput(platform, loop.stepTimestamp);
+            
+            //the trace holds the last PROFILE_RING_SIZE zones of every thread
+            if (platform->isKeyPressed('P')) writeProfileTrace("salamander_trace.json");
+            
+            if (platform->isKeyPressed('L')) lateLatch = !lateLatch;
+            
+            if (platform->isKeyPressed('M')) {
+                multiDraw = !multiDraw;
+                setRendererMultiDraw(renderer, multiDraw);
+            }
+            
+            if (platform->isKeyPressed('N')) {
+                upscaleFilter = (upscaleFilter == UPSCALE_NEAREST) ? UPSCALE_SHARP_BILINEAR : UPSCALE_NEAREST;
+            }
+            
+            if (platform->isKeyPressed('B')) {
+                debugMode = (debugMode + 1) % RENDERER_DEBUG_MODE_COUNT;
+                setRendererDebugMode(renderer, debugMode, debugShader);
+            }
+            
+            //skipped swaps do not wait for vsync, so the loop paces itself while partial redraw is on
+            if (platform->isKeyPressed('C')) {
+                partialRedraw = !partialRedraw;
+                setRendererPartialRedraw(renderer, partialRedraw);
+                loop.targetFrameTime = partialRedraw ? 1.0 / 60.0 : 0.0;
+            }
+            
+            if (platform->isKeyPressed('F')) {
+                struct FrameStats stats = loop.stats;
+                printf("frame %.2fms (avg %.2fms, min %.2fms, max %.2fms), input latency %.2fms\n", stats.frameTime * 1000.0,
+                       stats.averageFrameTime * 1000.0, stats.minFrameTime * 1000.0, stats.maxFrameTime * 1000.0, platform->inputLatency * 1000.0);
+                printf("%u draws, %u quads, %u gl state calls (%u elided)\n", renderStats.drawCalls, renderStats.quads,
+                       renderStats.glCalls, renderStats.glCallsElided);
+                printf("world pass %.2fms on the gpu at %.0f%% resolution\n", worldGPUTime * 1000.0, worldGPUScale * 100.0f);
+                printf("flushes: %u explicit, %u buffer full, %u texture slots, %u state change\n", renderStats.flushes[FLUSH_EXPLICIT],
+                       renderStats.flushes[FLUSH_BUFFER_FULL], renderStats.flushes[FLUSH_TEXTURE_SLOTS], renderStats.flushes[FLUSH_STATE_CHANGE]);
+            }
+            
+            moveCamera(&camera, platform, false, dt);
+            spin += SPIN_SPEED * dt;
+        }
         
-        if (platform->isKeyDown('S')) camera.position[1] += speed;
-        if (platform->isKeyDown('W')) camera.position[1] -= speed;
+        //render between the last two steps so motion stays smooth when the frame and step rates differ
+        glm_vec2_lerp(previousCamera.position, camera.position, loop.alpha, renderCamera.position);
+        renderCamera.zoom = glm_lerp(previousCamera.zoom, camera.zoom, loop.alpha);
+        renderCamera.rotation = glm_lerp(previousCamera.rotation, camera.rotation, loop.alpha);
         
-        if (platform->isKeyDown('Z')) camera.zoom += 0.001f;
-        if (platform->isKeyDown('X') && camera.zoom > 0.0f) camera.zoom -= 0.001f;
+        PROFILE_BEGIN("draw");
+        clearRenderer((vec4){ 0.0f, 0.0f, 0.0f, 1.0f });
         
-        if (platform->isKeyDown('R')) camera.rotation += 0.1f;
-        if (platform->isKeyDown('E')) camera.rotation -= 0.1f;
+        setRendererShader(renderer, shader);
+        setRendererBlendMode(renderer, BLEND_ALPHA);
+        setRendererLayer(renderer, 0.0f);
         
-        clearRenderer((vec4){ 0.0f, 0.0f, 0.0f, 1.0f });
+        //results come back a frame or two late, the scale follows whatever finished last
+        if (readGPUTimer(&worldTimer, &worldGPUTime, &worldGPUScale)) {
+            setRenderTargetScale(&worldTarget, updateResolutionController(&worldResolution, worldGPUTime, worldGPUScale));
+        }
+        
+        //the world only covers a ninth of the pixels, the whole target is upscaled as one quad below
+        beginRenderTarget(renderer, &worldTarget, (vec4){ 0.0f, 0.0f, 0.0f, 1.0f });
+        beginGPUTimer(&worldTimer, worldResolution.scale);
+        useRendererCamera(renderer, WORLD_CAMERA);
+        drawTexture(renderer, texture, (vec2){ 0.0f, 0.0f }, (vec2){ 1.0f, 1.0f });
+        drawTextureEx(renderer, texture2, (vec2){ 33.0f, 33.0f }, (vec2){ 1.0f, 1.0f }, (vec2){ 0.5f, 0.5f },
+                      glm_lerp(previousSpin, spin, loop.alpha), FULL_SOURCE_RECT, SPRITE_FLIP_NONE);
+        
+        //additive and alpha blend the same way on the gpu, so the glow stays in the batch
+        setRendererBlendMode(renderer, BLEND_ADDITIVE);
+        drawQuadEx(renderer, (vec2){ 33.0f, 33.0f }, (vec2){ 21.0f, 21.0f }, (vec2){ 0.5f, 0.5f }, 0.0f, (vec4){ 1.0f, 0.6f, 0.2f, 0.3f });
+        setRendererBlendMode(renderer, BLEND_ALPHA);
+        
+        //instead of interpolating, run the camera forward over the part of a step the frame is into using the
+        //newest input, the world batch is already recorded so only the uniform buffer changes
+        if (lateLatch) {
+            latchInput(platform);
+            
+            glm_vec2_copy(camera.position, renderCamera.position);
+            renderCamera.zoom = camera.zoom;
+            renderCamera.rotation = camera.rotation;
+            moveCamera(&renderCamera, platform, true, loop.alpha * (float)loop.fixedStep);
+        }
+        
+        //only uploaded when the camera actually moved
+        if (updateCamera(&renderCamera)) {
+            setRendererCamera(renderer, WORLD_CAMERA, renderCamera.viewProjectionMatrix);
+        }
         
-        useShader(shader);
-        setViewProjection(shader, &camera);
+        //drawn on the spot rather than batched, so it comes after the camera upload
+        drawSpriteBuffer(renderer, &field, vertexPullingShader, vertexPullingDebugShader);
         
-        drawTexture(renderer, texture, (vec2){ 0.0f, 0.0f }, renderScale);
-        drawTexture(renderer, texture2, (vec2){ 100.0f, 100.0f }, renderScale);
+        endRenderTarget(renderer);
+        endGPUTimer(&worldTimer);
         
-        flushRenderer(renderer);
-        useShader(NO_SHADER);
+        useRendererCamera(renderer, HUD_CAMERA);
+        drawUpscaledTarget(renderer, &worldTarget, upscaleFilter, sharpBilinearShader);
+        
+        //the bar is solid, so it goes in the opaque pass in front of the world
+        setRendererBlendMode(renderer, BLEND_OPAQUE);
+        setRendererLayer(renderer, 1.0f);
+        u32 barColours[4] = {
+            PACK_COLOUR(50, 200, 80, 255), PACK_COLOUR(200, 220, 60, 255),
+            PACK_COLOUR(200, 220, 60, 255), PACK_COLOUR(50, 200, 80, 255)
+        };
+        drawQuadGradient(renderer, (vec2){ 10.0f, 10.0f }, (vec2){ 200.0f, 16.0f }, barColours);
+        
+        //the target holds premultiplied colour, blending is what it was drawn with
+        setRendererBlendMode(renderer, BLEND_PREMULTIPLIED);
+        drawTexture(renderer, panel.texture, (vec2){ platform->windowWidth - PANEL_SIZE - 10.0f, 10.0f }, (vec2){ 1.0f, 1.0f });
+        setRendererBlendMode(renderer, BLEND_ALPHA);
+        
+        platform->skipSwap = !presentRenderer(renderer);
+        renderStats = resetRendererStats(renderer);
+        PROFILE_END();
         
         updatePlatform(platform);
+        
+        //past the first few frames everything should run out of memory that already exists
+        endAllocationFrame(true);
+        if (++frameCount == ALLOCATION_WARMUP_FRAMES) {
+            setAllocationGuard(true);
+        }
+        
+        endFrame(&loop);
+        PROFILE_END();
     }
     
     return 0;
@@ -0,0 +1,902 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+//NOTE: system headers go first, in debug builds basic.h redefines malloc and free for allocation tracking
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <limits.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#include "platform.h"
+#include "arena.h"
+#include "profiler.h"
+
+#define FILE_READ_CHUNK_SIZE (64 * 1024)
+
+//NOTE: single pass, grows the buffer as it goes since pipes and character devices have no size up front
+#ifdef _WIN32
+static Buffer streamFileIntoBuffer(HANDLE handle) {
+#else
+static Buffer streamFileIntoBuffer(int handle) {
+#endif
+    Buffer file = { 0 };
+    size_t capacity = 0;
+    
+    while (true) {
+        if (capacity - file.size < FILE_READ_CHUNK_SIZE) {
+            capacity = capacity ? capacity * 2 : FILE_READ_CHUNK_SIZE;
+            
+            //one extra byte so text files can still be treated as c strings
+            u8 *data = realloc(file.data, capacity + 1);
+            if (!data) {
+                free(file.data);
+                return (Buffer) { 0 };
+            }
+            file.data = data;
+        }
+        
+        //a read error fails the whole file, returning what came before it would pass off a truncated file
+#ifdef _WIN32
+        DWORD bytesRead = 0;
+        DWORD toRead = (DWORD)(capacity - file.size);
+        if (!ReadFile(handle, file.data + file.size, toRead, &bytesRead, NULL)) {
+            //the writing end of a pipe closing is its end of file
+            if (GetLastError() == ERROR_BROKEN_PIPE) break;
+            
+            free(file.data);
+            return (Buffer) { 0 };
+        }
+        if (bytesRead == 0) break;
+#else
+        ssize_t bytesRead = read(handle, file.data + file.size, capacity - file.size);
+        if (bytesRead < 0) {
+            if (errno == EINTR) continue;
+            
+            free(file.data);
+            return (Buffer) { 0 };
+        }
+        if (bytesRead == 0) break;
+#endif
+        
+        file.size += bytesRead;
+    }
+    
+    if (file.data) {
+        file.data[file.size] = '\0';
+    }
+    
+    return file;
+}
+
+Buffer readFileIntoBuffer(char *path) {
+    Buffer file = { 0 };
+    
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return file;
+    
+    file = streamFileIntoBuffer(handle);
+    CloseHandle(handle);
+#else
+    int handle = open(path, O_RDONLY);
+    if (handle == -1) return file;
+    
+    file = streamFileIntoBuffer(handle);
+    close(handle);
+#endif
+    
+    return file;
+}
+
+Buffer mapFileIntoBuffer(char *path) {
+    Buffer file = { 0 };
+    
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return file;
+    
+    LARGE_INTEGER size;
+    if (GetFileType(handle) != FILE_TYPE_DISK || !GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        file = streamFileIntoBuffer(handle);
+        CloseHandle(handle);
+        return file;
+    }
+    
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+        file.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    
+    if (file.data) {
+        file.size = (size_t)size.QuadPart;
+        file.mapped = true;
+    } else {
+        file = streamFileIntoBuffer(handle);
+    }
+    
+    CloseHandle(handle);
+#else
+    int handle = open(path, O_RDONLY);
+    if (handle == -1) return file;
+    
+    //empty files cannot be mapped and pipes have nothing to map
+    struct stat status;
+    if (fstat(handle, &status) == -1 || !S_ISREG(status.st_mode) || status.st_size == 0) {
+        file = streamFileIntoBuffer(handle);
+        close(handle);
+        return file;
+    }
+    
+    void *view = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+    if (view != MAP_FAILED) {
+        //we almost always read the whole thing front to back, so start readahead right away
+        madvise(view, status.st_size, MADV_WILLNEED);
+        
+        file.data = view;
+        file.size = status.st_size;
+        file.mapped = true;
+    } else {
+        file = streamFileIntoBuffer(handle);
+    }
+    
+    close(handle);
+#endif
+    
+    return file;
+}
+
+void freeBuffer(Buffer *buffer) {
+    if (buffer->mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(buffer->data);
+#else
+        munmap(buffer->data, buffer->size);
+#endif
+    } else {
+        free(buffer->data);
+    }
+    
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->mapped = false;
+}
+
+//NOTE: qpc and CLOCK_MONOTONIC rather than rdtsc, both are invariant and need no calibration
+u64 getTimestamp(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (u64)counter.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1000000000ull + (u64)time.tv_nsec;
+#endif
+}
+
+u64 getTimestampFrequency(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return (u64)frequency.QuadPart;
+#else
+    return 1000000000ull;
+#endif
+}
+
+double getSecondsBetween(u64 start, u64 end) {
+    static double secondsPerTick;
+    if (secondsPerTick == 0.0) {
+        secondsPerTick = 1.0 / (double)getTimestampFrequency();
+    }
+    
+    return (double)(i64)(end - start) * secondsPerTick;
+}
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+void sleepFor(double seconds) {
+    if (seconds <= 0.0) return;
+    
+#ifdef _WIN32
+    //Sleep() rounds up to the 15.6ms scheduler tick, high resolution timers (windows 10 1803+) do not
+    static HANDLE timer;
+    static bool timerCreated;
+    
+    if (!timerCreated) {
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        timerCreated = true;
+    }
+    
+    if (timer) {
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -(LONGLONG)(seconds * 10000000.0);
+        
+        if (SetWaitableTimer(timer, &dueTime, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject(timer, INFINITE);
+            return;
+        }
+    }
+    
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    struct timespec time;
+    time.tv_sec = (time_t)seconds;
+    time.tv_nsec = (long)((seconds - (double)time.tv_sec) * 1000000000.0);
+    
+    while (nanosleep(&time, &time) == -1 && errno == EINTR);
+#endif
+}
+
+struct Thread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    ThreadProc proc;
+    void *data;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI threadEntry(LPVOID parameter) {
+#else
+static void *threadEntry(void *parameter) {
+#endif
+    struct Thread *thread = parameter;
+    thread->proc(thread->data);
+    
+    releaseProfileThread();
+    
+    return 0;
+}
+
+struct Thread *createThread(ThreadProc proc, void *data) {
+    struct Thread *thread = malloc(sizeof(struct Thread));
+    thread->proc = proc;
+    thread->data = data;
+    
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, threadEntry, thread, 0, NULL);
+    bool created = (thread->handle != NULL);
+#else
+    bool created = (pthread_create(&thread->handle, NULL, threadEntry, thread) == 0);
+#endif
+    
+    if (!created) {
+        free(thread);
+        return NULL;
+    }
+    
+    return thread;
+}
+
+void joinThread(struct Thread *thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    
+    free(thread);
+}
+
+int getProcessorCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+#endif
+}
+
+struct Semaphore {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    sem_t handle;
+#endif
+};
+
+struct Semaphore *createSemaphore(int initialCount) {
+    struct Semaphore *semaphore = malloc(sizeof(struct Semaphore));
+    
+#ifdef _WIN32
+    semaphore->handle = CreateSemaphoreA(NULL, initialCount, LONG_MAX, NULL);
+#else
+    sem_init(&semaphore->handle, 0, initialCount);
+#endif
+    
+    return semaphore;
+}
+
+void signalSemaphore(struct Semaphore *semaphore) {
+#ifdef _WIN32
+    ReleaseSemaphore(semaphore->handle, 1, NULL);
+#else
+    sem_post(&semaphore->handle);
+#endif
+}
+
+void waitSemaphore(struct Semaphore *semaphore) {
+#ifdef _WIN32
+    WaitForSingleObject(semaphore->handle, INFINITE);
+#else
+    while (sem_wait(&semaphore->handle) == -1) {
+        //interrupted by a signal, keep waiting
+    }
+#endif
+}
+
+void freeSemaphore(struct Semaphore *semaphore) {
+#ifdef _WIN32
+    CloseHandle(semaphore->handle);
+#else
+    sem_destroy(&semaphore->handle);
+#endif
+    
+    free(semaphore);
+}
+
+i32 atomicAdd(volatile i32 *value, i32 addend) {
+#ifdef _MSC_VER
+    return InterlockedExchangeAdd((volatile LONG *)value, addend);
+#else
+    return __atomic_fetch_add(value, addend, __ATOMIC_SEQ_CST);
+#endif
+}
+
+i32 atomicLoad(volatile i32 *value) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange((volatile LONG *)value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void atomicStore(volatile i32 *value, i32 newValue) {
+#ifdef _MSC_VER
+    InterlockedExchange((volatile LONG *)value, newValue);
+#else
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+bool atomicCompareExchange(volatile i32 *value, i32 expected, i32 desired) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange((volatile LONG *)value, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+#define FILE_BATCH_MAX_THREADS 8
+
+struct FileBatch {
+    char **paths;
+    Buffer *files;
+    int count;
+    
+    //NOTE: the lock guards the arena and the completion queue, it is just a semaphore with a count of one
+    struct Arena *arena;
+    struct Semaphore *lock;
+    
+    struct Semaphore *ready;
+    int *completed;
+    int completedCount;
+    int consumedCount;
+    
+    volatile i32 claimedCount;
+    volatile i32 nextRead;
+    
+    struct Thread *threads[FILE_BATCH_MAX_THREADS];
+    int threadCount;
+};
+
+static u8 *allocateBatchBuffer(struct FileBatch *batch, size_t size) {
+    waitSemaphore(batch->lock);
+    u8 *data = arenaAlloc(batch->arena, size + 1);
+    signalSemaphore(batch->lock);
+    
+    return data;
+}
+
+static void completeBatchFile(struct FileBatch *batch, int index) {
+    if (batch->files[index].data) {
+        batch->files[index].data[batch->files[index].size] = '\0';
+    }
+    
+    waitSemaphore(batch->lock);
+    batch->completed[batch->completedCount++] = index;
+    signalSemaphore(batch->lock);
+    
+    signalSemaphore(batch->ready);
+}
+
+//pipes and other files without a known size get streamed onto the heap first and then copied over
+static void copyStreamedBatchFile(struct FileBatch *batch, int index, Buffer streamed) {
+    Buffer *file = &batch->files[index];
+    
+    if (streamed.data) {
+        file->data = allocateBatchBuffer(batch, streamed.size);
+        file->size = streamed.size;
+        memcpy(file->data, streamed.data, streamed.size);
+        
+        freeBuffer(&streamed);
+    }
+}
+
+static void readBatchFile(struct FileBatch *batch, int index) {
+    Buffer *file = &batch->files[index];
+    char *path = batch->paths[index];
+    
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return;
+    
+    LARGE_INTEGER size;
+    if (GetFileType(handle) != FILE_TYPE_DISK || !GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        copyStreamedBatchFile(batch, index, streamFileIntoBuffer(handle));
+        CloseHandle(handle);
+        return;
+    }
+    
+    file->data = allocateBatchBuffer(batch, (size_t)size.QuadPart);
+    
+    while (file->size < (size_t)size.QuadPart) {
+        DWORD bytesRead = 0;
+        DWORD toRead = (DWORD)(((size_t)size.QuadPart - file->size > 0x40000000) ? 0x40000000 : (size_t)size.QuadPart - file->size);
+        if (!ReadFile(handle, file->data + file->size, toRead, &bytesRead, NULL)) {
+            *file = (Buffer) { 0 };
+            break;
+        }
+        if (bytesRead == 0) break;
+        
+        file->size += bytesRead;
+    }
+    
+    CloseHandle(handle);
+#else
+    int handle = open(path, O_RDONLY);
+    if (handle == -1) return;
+    
+    struct stat status;
+    if (fstat(handle, &status) == -1 || !S_ISREG(status.st_mode) || status.st_size == 0) {
+        copyStreamedBatchFile(batch, index, streamFileIntoBuffer(handle));
+        close(handle);
+        return;
+    }
+    
+    file->data = allocateBatchBuffer(batch, status.st_size);
+    
+    while (file->size < (size_t)status.st_size) {
+        ssize_t bytesRead = pread(handle, file->data + file->size, status.st_size - file->size, file->size);
+        if (bytesRead < 0 && errno == EINTR) continue;
+        
+        //failed reads leave the file empty like a failed open, the arena keeps the buffer until the batch goes
+        if (bytesRead < 0) {
+            *file = (Buffer) { 0 };
+            break;
+        }
+        if (bytesRead == 0) break;
+        
+        file->size += bytesRead;
+    }
+    
+    close(handle);
+#endif
+}
+
+static void fileReaderProc(void *data) {
+    struct FileBatch *batch = data;
+    setProfileThreadName("file reader");
+    
+    i32 index;
+    while ((index = atomicAdd(&batch->nextRead, 1)) < batch->count) {
+        PROFILE_BEGIN("readBatchFile");
+        readBatchFile(batch, index);
+        PROFILE_END();
+        
+        completeBatchFile(batch, index);
+    }
+}
+
+#ifdef __linux__
+#define URING_ENTRIES 64
+
+struct Uring {
+    int fd;
+    u32 entries;
+    
+    u32 *sqHead;
+    u32 *sqTail;
+    u32 *sqMask;
+    u32 *sqArray;
+    struct io_uring_sqe *sqes;
+    u32 queued;
+    
+    u32 *cqHead;
+    u32 *cqTail;
+    u32 *cqMask;
+    struct io_uring_cqe *cqes;
+    
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+};
+
+//NOTE: hand rolled instead of pulling in liburing, we only ever need openat and read
+static bool createUring(struct Uring *ring) {
+    struct io_uring_params params = { 0 };
+    
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    
+    //fast poll came with 5.7, openat and read are both older than that
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+        close(ring->fd);
+        return false;
+    }
+    
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sqRing :
+        mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqesSize);
+        if (ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+        if (ring->sqRing != MAP_FAILED) munmap(ring->sqRing, ring->sqRingSize);
+        close(ring->fd);
+        return false;
+    }
+    
+    u8 *sq = ring->sqRing;
+    ring->sqHead = (u32 *)(sq + params.sq_off.head);
+    ring->sqTail = (u32 *)(sq + params.sq_off.tail);
+    ring->sqMask = (u32 *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (u32 *)(sq + params.sq_off.array);
+    
+    u8 *cq = ring->cqRing;
+    ring->cqHead = (u32 *)(cq + params.cq_off.head);
+    ring->cqTail = (u32 *)(cq + params.cq_off.tail);
+    ring->cqMask = (u32 *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    
+    ring->queued = 0;
+    
+    return true;
+}
+
+static void freeUring(struct Uring *ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+}
+
+static struct io_uring_sqe *getUringSqe(struct Uring *ring) {
+    u32 tail = *ring->sqTail;
+    u32 index = tail & *ring->sqMask;
+    
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    
+    return sqe;
+}
+
+enum UringFileState {
+    URING_FILE_OPENING,
+    URING_FILE_READING,
+    URING_FILE_DONE,
+};
+
+struct UringBatch {
+    struct FileBatch *batch;
+    struct Uring ring;
+    
+    u8 *states;
+    int *fds;
+    size_t *sizes;
+};
+
+static void queueUringRead(struct UringBatch *uring, int index) {
+    Buffer *file = &uring->batch->files[index];
+    
+    struct io_uring_sqe *sqe = getUringSqe(&uring->ring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = uring->fds[index];
+    sqe->addr = (u64)(uintptr_t)(file->data + file->size);
+    sqe->len = (u32)(((uring->sizes[index] - file->size) > 0x40000000) ? 0x40000000 : (uring->sizes[index] - file->size));
+    sqe->off = file->size;
+    sqe->user_data = index;
+}
+
+static void finishUringFile(struct UringBatch *uring, int index) {
+    if (uring->fds[index] >= 0) {
+        close(uring->fds[index]);
+    }
+    
+    uring->states[index] = URING_FILE_DONE;
+    completeBatchFile(uring->batch, index);
+}
+
+//returns false once the file is done, true if another read was queued for it
+static bool handleUringCompletion(struct UringBatch *uring, int index, int result) {
+    struct FileBatch *batch = uring->batch;
+    Buffer *file = &batch->files[index];
+    
+    if (uring->states[index] == URING_FILE_OPENING) {
+        if (result < 0) {
+            uring->fds[index] = -1;
+            finishUringFile(uring, index);
+            return false;
+        }
+        
+        uring->fds[index] = result;
+        
+        struct stat status;
+        if (fstat(result, &status) == -1 || !S_ISREG(status.st_mode) || status.st_size == 0) {
+            copyStreamedBatchFile(batch, index, streamFileIntoBuffer(result));
+            finishUringFile(uring, index);
+            return false;
+        }
+        
+        uring->states[index] = URING_FILE_READING;
+        uring->sizes[index] = status.st_size;
+        file->data = allocateBatchBuffer(batch, status.st_size);
+        
+        queueUringRead(uring, index);
+        return true;
+    }
+    
+    if (result == -EINTR || result == -EAGAIN) {
+        queueUringRead(uring, index);
+        return true;
+    }
+    
+    if (result > 0) {
+        file->size += result;
+        
+        if (file->size < uring->sizes[index]) {
+            queueUringRead(uring, index);
+            return true;
+        }
+    }
+    
+    //a failed read fails the file, what came before it would pass for a truncated file
+    if (result < 0) {
+        *file = (Buffer) { 0 };
+    }
+    
+    finishUringFile(uring, index);
+    return false;
+}
+
+static void uringReaderProc(void *data) {
+    struct UringBatch *uring = data;
+    struct FileBatch *batch = uring->batch;
+    struct Uring *ring = &uring->ring;
+    setProfileThreadName("io_uring reader");
+    
+    int nextOpen = 0;
+    int finishedCount = 0;
+    u32 inFlight = 0;
+    
+    while (finishedCount < batch->count) {
+        //every file only ever has one request in flight, so this also keeps the completion queue from overflowing
+        while (nextOpen < batch->count && inFlight < ring->entries) {
+            struct io_uring_sqe *sqe = getUringSqe(ring);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (u64)(uintptr_t)batch->paths[nextOpen];
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = nextOpen;
+            
+            nextOpen++;
+            inFlight++;
+        }
+        
+        PROFILE_BEGIN("io_uring_enter");
+        int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        PROFILE_END();
+        
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            
+            //the ring is unusable, whatever is still in flight is reported as failed and the rest is read directly
+            printf("ERROR io_uring_enter failed (%d), finishing the batch without it!\n", errno);
+            
+            //opens that already completed have descriptors nobody will read from
+            u32 head = *ring->cqHead;
+            u32 tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+                if (uring->states[cqe->user_data] == URING_FILE_OPENING && cqe->res >= 0) {
+                    close(cqe->res);
+                }
+            }
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+            
+            for (int i = 0; i < nextOpen; i++) {
+                if (uring->states[i] == URING_FILE_READING) {
+                    close(uring->fds[i]);
+                }
+                
+                if (uring->states[i] != URING_FILE_DONE) {
+                    batch->files[i] = (Buffer) { 0 };
+                    completeBatchFile(batch, i);
+                }
+            }
+            
+            for (int i = nextOpen; i < batch->count; i++) {
+                readBatchFile(batch, i);
+                completeBatchFile(batch, i);
+            }
+            
+            break;
+        }
+        ring->queued -= submitted;
+        
+        u32 head = *ring->cqHead;
+        u32 tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+            
+            if (!handleUringCompletion(uring, (int)cqe->user_data, cqe->res)) {
+                inFlight--;
+                finishedCount++;
+            }
+            
+            head++;
+        }
+        
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+    
+    freeUring(ring);
+    free(uring->states);
+    free(uring->fds);
+    free(uring->sizes);
+    free(uring);
+}
+
+static bool startUringBatch(struct FileBatch *batch) {
+    struct UringBatch *uring = malloc(sizeof(struct UringBatch));
+    uring->batch = batch;
+    
+    if (!createUring(&uring->ring)) {
+        free(uring);
+        return false;
+    }
+    
+    uring->states = calloc(batch->count, sizeof(u8));
+    uring->fds = calloc(batch->count, sizeof(int));
+    uring->sizes = calloc(batch->count, sizeof(size_t));
+    
+    batch->threads[batch->threadCount] = createThread(uringReaderProc, uring);
+    if (!batch->threads[batch->threadCount]) {
+        freeUring(&uring->ring);
+        free(uring->states);
+        free(uring->fds);
+        free(uring->sizes);
+        free(uring);
+        return false;
+    }
+    batch->threadCount++;
+    
+    return true;
+}
+#endif
+
+struct FileBatch *beginFileBatch(char **paths, int count, struct Arena *arena) {
+    struct FileBatch *batch = malloc(sizeof(struct FileBatch));
+    memset(batch, 0, sizeof(struct FileBatch));
+    
+    batch->paths = paths;
+    batch->count = count;
+    batch->arena = arena;
+    
+    batch->files = calloc(count, sizeof(Buffer));
+    batch->completed = calloc(count, sizeof(int));
+    
+    batch->lock = createSemaphore(1);
+    batch->ready = createSemaphore(0);
+    
+    if (count == 0) {
+        return batch;
+    }
+    
+#ifdef __linux__
+    if (startUringBatch(batch)) {
+        return batch;
+    }
+#endif
+    
+    int threadCount = (count < FILE_BATCH_MAX_THREADS) ? count : FILE_BATCH_MAX_THREADS;
+    for (int i = 0; i < threadCount; i++) {
+        struct Thread *thread = createThread(fileReaderProc, batch);
+        if (thread) {
+            batch->threads[batch->threadCount++] = thread;
+        }
+    }
+    
+    //no threads at all, read everything right here so callers still get their files
+    if (batch->threadCount == 0) {
+        fileReaderProc(batch);
+    }
+    
+    return batch;
+}
+
+int waitForNextFile(struct FileBatch *batch, Buffer *file) {
+    if (atomicAdd(&batch->claimedCount, 1) >= batch->count) {
+        return -1;
+    }
+    
+    waitSemaphore(batch->ready);
+    
+    waitSemaphore(batch->lock);
+    int index = batch->completed[batch->consumedCount++];
+    signalSemaphore(batch->lock);
+    
+    *file = batch->files[index];
+    
+    return index;
+}
+
+void freeFileBatch(struct FileBatch *batch) {
+    for (int i = 0; i < batch->threadCount; i++) {
+        joinThread(batch->threads[i]);
+    }
+    
+    freeSemaphore(batch->lock);
+    freeSemaphore(batch->ready);
+    
+    free(batch->files);
+    free(batch->completed);
+    free(batch);
+}
\ No newline at end of file
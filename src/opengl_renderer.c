@@ -1,49 +1,307 @@
 #include "renderer.h"
 #include "platform.h"
+#include "arena.h"
+#include "profiler.h"
+#include "fast_math.h"
 
 #include <glad/glad.h>
+#include <float.h>
+
+static THREAD_LOCAL struct Arena *t_imageArena;
+
+static void *imageAlloc(size_t size) {
+    return t_imageArena ? arenaAlloc(t_imageArena, size) : malloc(size);
+}
+
+static void *imageRealloc(void *memory, size_t oldSize, size_t newSize) {
+    if (t_imageArena && (!memory || arenaOwns(t_imageArena, memory))) {
+        return arenaRealloc(t_imageArena, memory, oldSize, newSize);
+    }
+    
+    return realloc(memory, newSize);
+}
+
+static void imageFree(void *memory) {
+    if (t_imageArena && arenaOwns(t_imageArena, memory)) {
+        return;
+    }
+    
+    free(memory);
+}
+
+#define STBI_MALLOC(size) imageAlloc(size)
+#define STBI_REALLOC_SIZED(memory, oldSize, newSize) imageRealloc(memory, oldSize, newSize)
+#define STBI_FREE(memory) imageFree(memory)
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-static struct Shader createShader(const char *vertexShaderSource, const char *fragmentShaderSource) {
+#define GL_STATE_TEXTURE_UNITS 32
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+
+//mirrors what we last told gl so calls that would not change anything never reach the driver, anything
+//without a known starting value is unknown so the first call of that kind always goes through
+struct GLStateCache {
+    u32 program;
+    u32 vertexArray;
+    u32 arrayBuffer;
+    u32 textureUnits[GL_STATE_TEXTURE_UNITS];
+    u32 drawFramebuffer;
+    
+    u32 blendEnabled;
+    u32 blendSource;
+    u32 blendDestination;
+    
+    u32 scissorEnabled;
+    int scissor[4];
+    u32 clipDistancesEnabled;
+    
+    u32 depthTestEnabled;
+    u32 depthFunction;
+    u32 depthWrite;
+    
+    vec4 clearColour;
+    
+    u32 calls;
+    u32 elidedCalls;
+};
+
+static struct GLStateCache g_glState = {
+    .program = GL_STATE_UNKNOWN,
+    .vertexArray = GL_STATE_UNKNOWN,
+    .arrayBuffer = GL_STATE_UNKNOWN,
+    .drawFramebuffer = GL_STATE_UNKNOWN,
+    .blendEnabled = GL_STATE_UNKNOWN,
+    .blendSource = GL_STATE_UNKNOWN,
+    .blendDestination = GL_STATE_UNKNOWN,
+    .scissorEnabled = GL_STATE_UNKNOWN,
+    .clipDistancesEnabled = GL_STATE_UNKNOWN,
+    .depthTestEnabled = GL_STATE_UNKNOWN,
+    .depthFunction = GL_STATE_UNKNOWN,
+    .depthWrite = GL_STATE_UNKNOWN,
+    .scissor = { -1, -1, -1, -1 },
+    .clearColour = { -1.0f, -1.0f, -1.0f, -1.0f },
+};
+
+static bool changeGLState(u32 *cached, u32 value) {
+    if (*cached == value) {
+        g_glState.elidedCalls++;
+        return false;
+    }
+    
+    *cached = value;
+    g_glState.calls++;
+    return true;
+}
+
+static void useProgram(u32 program) {
+    if (changeGLState(&g_glState.program, program)) glUseProgram(program);
+}
+
+static void bindVertexArray(u32 vertexArray) {
+    if (changeGLState(&g_glState.vertexArray, vertexArray)) glBindVertexArray(vertexArray);
+}
+
+static void bindArrayBuffer(u32 buffer) {
+    if (changeGLState(&g_glState.arrayBuffer, buffer)) glBindBuffer(GL_ARRAY_BUFFER, buffer);
+}
+
+static void bindTextureUnit(u32 unit, u32 texture) {
+    if (changeGLState(&g_glState.textureUnits[unit], texture)) glBindTextureUnit(unit, texture);
+}
+
+static void bindDrawFramebuffer(u32 framebuffer) {
+    if (changeGLState(&g_glState.drawFramebuffer, framebuffer)) glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+}
+
+static void setBlendEnabled(bool enabled) {
+    if (changeGLState(&g_glState.blendEnabled, enabled)) {
+        if (enabled) glEnable(GL_BLEND);
+        else glDisable(GL_BLEND);
+    }
+}
+
+static void setBlendFunction(u32 source, u32 destination) {
+    if (g_glState.blendSource == source && g_glState.blendDestination == destination) {
+        g_glState.elidedCalls++;
+        return;
+    }
+    
+    g_glState.blendSource = source;
+    g_glState.blendDestination = destination;
+    g_glState.calls++;
+    glBlendFunc(source, destination);
+}
+
+static void setScissorEnabled(bool enabled) {
+    if (changeGLState(&g_glState.scissorEnabled, enabled)) {
+        if (enabled) glEnable(GL_SCISSOR_TEST);
+        else glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+static void setScissorRect(int x, int y, int width, int height) {
+    int *scissor = g_glState.scissor;
+    if (scissor[0] == x && scissor[1] == y && scissor[2] == width && scissor[3] == height) {
+        g_glState.elidedCalls++;
+        return;
+    }
+    
+    scissor[0] = x;
+    scissor[1] = y;
+    scissor[2] = width;
+    scissor[3] = height;
+    g_glState.calls++;
+    glScissor(x, y, width, height);
+}
+
+//the four planes of the clip rect, see clipToRect in default.glsl
+static void setClipDistancesEnabled(bool enabled) {
+    if (changeGLState(&g_glState.clipDistancesEnabled, enabled)) {
+        for (int i = 0; i < 4; i++) {
+            if (enabled) glEnable(GL_CLIP_DISTANCE0 + i);
+            else glDisable(GL_CLIP_DISTANCE0 + i);
+        }
+    }
+}
+
+static void setDepthTestEnabled(bool enabled) {
+    if (changeGLState(&g_glState.depthTestEnabled, enabled)) {
+        if (enabled) glEnable(GL_DEPTH_TEST);
+        else glDisable(GL_DEPTH_TEST);
+    }
+}
+
+static void setDepthFunction(u32 function) {
+    if (changeGLState(&g_glState.depthFunction, function)) glDepthFunc(function);
+}
+
+static void setDepthWrite(bool enabled) {
+    if (changeGLState(&g_glState.depthWrite, enabled)) glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+static void setClearColour(vec4 colour) {
+    if (glm_vec4_eqv(g_glState.clearColour, colour)) {
+        g_glState.elidedCalls++;
+        return;
+    }
+    
+    glm_vec4_copy(colour, g_glState.clearColour);
+    g_glState.calls++;
+    glClearColor(colour[0], colour[1], colour[2], colour[3]);
+}
+
+//gl drops deleted objects from its bindings and hands their names out again, the cache has to forget them too
+static void forgetDeletedProgram(u32 program) {
+    if (g_glState.program == program) g_glState.program = GL_STATE_UNKNOWN;
+}
+
+static void forgetDeletedTexture(u32 texture) {
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+        if (g_glState.textureUnits[i] == texture) g_glState.textureUnits[i] = GL_STATE_UNKNOWN;
+    }
+}
+
+struct ShaderStageSource {
+    int count;
+    const char **strings;
+    const int *lengths;
+};
+
+//NOTE: not in our glad headers, the enum is shared by the KHR and ARB versions of the extension
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+struct PendingShader {
+    u32 program;
+    u32 vertexShader;
+    u32 fragmentShader;
+};
+
+static bool hasParallelShaderCompile(void) {
+    static int supported = -1;
+    
+    if (supported == -1) {
+        supported = 0;
+        
+        int extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        
+        for (int i = 0; i < extensionCount; i++) {
+            const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0) {
+                supported = 1;
+                break;
+            }
+        }
+    }
+    
+    return supported;
+}
+
+//kicks off compilation and linking without asking for any results, so the driver is free to do the work in the background
+static struct PendingShader submitShader(struct ShaderStageSource vertexSource, struct ShaderStageSource fragmentSource) {
+    struct PendingShader pending = { 0 };
+    
+    if (vertexSource.count && fragmentSource.count) {
+        
+        pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pending.vertexShader, vertexSource.count, vertexSource.strings, vertexSource.lengths);
+        glCompileShader(pending.vertexShader);
+        
+        pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pending.fragmentShader, fragmentSource.count, fragmentSource.strings, fragmentSource.lengths);
+        glCompileShader(pending.fragmentShader);
+        
+        pending.program = glCreateProgram();
+        
+        glAttachShader(pending.program, pending.vertexShader);
+        glAttachShader(pending.program, pending.fragmentShader);
+        
+        glLinkProgram(pending.program);
+        
+    }
+    
+    return pending;
+}
+
+static bool isShaderReady(struct PendingShader *pending) {
+    if (!pending->program || !hasParallelShaderCompile()) {
+        return true;
+    }
+    
+    int result;
+    glGetProgramiv(pending->program, GL_COMPLETION_STATUS_KHR, &result);
+    
+    return result;
+}
+
+//NOTE: blocks until the driver is done with the shader
+static struct Shader resolveShader(struct PendingShader *pending) {
     struct Shader shader = { 0 };
     int result;
     
-    if (vertexShaderSource && fragmentShaderSource) {
-        
-        u32 vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-        glCompileShader(vertexShader);
+    if (pending->program) {
         
-        glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &result);
+        glGetShaderiv(pending->vertexShader, GL_COMPILE_STATUS, &result);
         if (!result) {
             int logLength;
             char message[1024];
-            glGetShaderInfoLog(vertexShader, 1024, &logLength, message);
+            glGetShaderInfoLog(pending->vertexShader, 1024, &logLength, message);
             
             printf("ERROR compiling vertex shader!\n%s\n", message);
         }
         
-        u32 fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-        glCompileShader(fragmentShader);
-        
-        glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &result);
+        glGetShaderiv(pending->fragmentShader, GL_COMPILE_STATUS, &result);
         if (!result) {
             int logLength;
             char message[1024];
-            glGetShaderInfoLog(fragmentShader, 1024, &logLength, message);
+            glGetShaderInfoLog(pending->fragmentShader, 1024, &logLength, message);
             
             printf("ERROR compiling fragment shader!\n%s\n", message);
         }
         
-        shader.id = glCreateProgram();
-        
-        glAttachShader(shader.id, vertexShader);
-        glAttachShader(shader.id, fragmentShader);
+        shader.id = pending->program;
         
-        glLinkProgram(shader.id);
         glGetProgramiv(shader.id, GL_LINK_STATUS, &result);
         if (!result) {
             int logLength;
@@ -65,298 +323,1731 @@ static struct Shader createShader(const char *vertexShaderSource, const char *fr
         }
 #endif
         
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        
-    }
-    
-    return shader;
-}
-
-struct Shader loadShader(char *path) {
-    Buffer file = readFileIntoBuffer(path);
-    int copySize = 0;
-    
-    int vsLen = strlen("#VERTEX_SHADER");
-    int fsLen = strlen("#FRAGMENT_SHADER");
-    
-    int vertexShaderOffset = findLineInBuffer(file, "#VERTEX_SHADER") + vsLen;
-    int fragmentShaderOffset = findLineInBuffer(file, "#FRAGMENT_SHADER") + fsLen;
-    
-    char *vertexShaderSource = NULL;
-    char *fragmentShaderSource = NULL;
-    
-    if (vertexShaderOffset != -1 && fragmentShaderOffset != -1) {
-        
-        int vertexShaderSize = ((fragmentShaderOffset - 1) - fsLen) - vertexShaderOffset;
-        vertexShaderSource = malloc(vertexShaderSize);
-        memset(vertexShaderSource, 0, vertexShaderSize);
-        
-        copySize = vertexShaderSize - 1;
-        memcpy_s(vertexShaderSource, copySize, file.data + vertexShaderOffset, copySize);
-        
-        int fragmentShaderSize = file.size - (fragmentShaderOffset - 1);
-        fragmentShaderSource = malloc(fragmentShaderSize);
-        memset(fragmentShaderSource, 0, fragmentShaderSize);
-        
-        copySize = fragmentShaderSize - 1;
-        memcpy_s(fragmentShaderSource, copySize, file.data + fragmentShaderOffset, copySize);
+        glDeleteShader(pending->vertexShader);
+        glDeleteShader(pending->fragmentShader);
         
     }
     
-    struct Shader shader = createShader(vertexShaderSource, fragmentShaderSource);
-    
-    free(vertexShaderSource);
-    free(fragmentShaderSource);
-    free(file.data);
+    *pending = (struct PendingShader) { 0 };
     
     return shader;
 }
 
-void useShader(struct Shader shader) {
-    glUseProgram(shader.id);
-}
+#define SHADER_MAX_FILES 8
+#define SHADER_MAX_INCLUDE_DEPTH 4
+#define SHADER_MAX_SLICES 32
+#define SHADER_MAX_VARIANTS 16
+#define SHADER_MAX_DEFINES_LENGTH 256
 
-void setShaderMat4(struct Shader shader, char *uniform, mat4 matrix) {
-    int location = glGetUniformLocation(shader.id, uniform);
-    glUniformMatrix4fv(location, 1, GL_FALSE, &matrix[0][0]);
-}
+enum ShaderStage {
+    SHADER_STAGE_VERTEX,
+    SHADER_STAGE_FRAGMENT,
+    SHADER_STAGE_COUNT,
+};
 
-struct Vertex {
-    vec4 position;
-    vec4 colour;
+struct ShaderStageSlices {
+    const char *version;
+    int versionLength;
     
-    vec2 textureCoordinates;
-    float textureIndex;
+    const char *data[SHADER_MAX_SLICES];
+    int lengths[SHADER_MAX_SLICES];
+    int count;
 };
 
-#define VERTICES_PER_QUAD 4
-#define INDICIES_PER_QUAD 6
+struct ShaderVariant {
+    u32 hash;
+    char defines[SHADER_MAX_DEFINES_LENGTH];
+    struct Shader shader;
+};
 
-#define RENDERER_TEXTURE_SLOTS 32
-struct Renderer {
-    u32 maxQuadsPerBatch;
+//NOTE: keeps the source files loaded so variants can be compiled on first use
+struct ShaderTemplate {
+    Buffer files[SHADER_MAX_FILES];
+    int fileCount;
     
-    u32 vao;
-    u32 vbo;
-    u32 ibo;
-    
-    struct Vertex *buffer;
-    u32 currentQuadCount;
+    struct ShaderStageSlices stages[SHADER_STAGE_COUNT];
+    bool valid;
     
-    struct Texture textureSlots[RENDERER_TEXTURE_SLOTS];
-    int currentTextureIndex;
+    struct ShaderVariant variants[SHADER_MAX_VARIANTS];
+    int variantCount;
 };
 
-static struct Renderer g_renderer;
-
-#ifdef SALAMANDER_DEBUG
-void errorCallback(u32 source, u32 type, u32 id, u32 severity, int length, const char* message, const void* userParam) {
-    char *typeString = (type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : "");
-    printf("GL CALLBACK: %s type = 0x%x, severity = 0x%x, message = %s\n", typeString, type, severity, message );
+static bool lineStartsWith(const char *line, const char *end, const char *tag) {
+    int length = (int)strlen(tag);
+    return (end - line) >= length && strncmp(line, tag, length) == 0;
 }
-#endif
 
-struct Renderer *createRenderer(int maxQuadsPerBatch) {
-    struct Renderer *renderer = &g_renderer;
-    renderer->maxQuadsPerBatch = maxQuadsPerBatch;
-    
-#ifdef SALAMANDER_DEBUG
-    glEnable(GL_DEBUG_OUTPUT);
-    glDebugMessageCallback(errorCallback, 0);
-#endif
-    
-    glCreateVertexArrays(1, &renderer->vao);
-    glBindVertexArray(renderer->vao);
+static void addShaderSlice(struct ShaderTemplate *shaderTemplate, int stage, const char *start, const char *end) {
+    if (stage < 0 || end <= start) return;
     
-    glCreateBuffers(1, &renderer->vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
-    
-    glEnableVertexArrayAttrib(renderer->vbo, 0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, position));
-    
-    glEnableVertexArrayAttrib(renderer->vbo, 1);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, colour));
-    
-    glEnableVertexArrayAttrib(renderer->vbo, 2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, textureCoordinates));
+    struct ShaderStageSlices *slices = &shaderTemplate->stages[stage];
+    if (slices->count == SHADER_MAX_SLICES) {
+        printf("ERROR too many includes in shader!\n");
+        shaderTemplate->valid = false;
+        return;
+    }
     
-    glEnableVertexArrayAttrib(renderer->vbo, 3);
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, textureIndex));
+    slices->data[slices->count] = start;
+    slices->lengths[slices->count] = (int)(end - start);
+    slices->count++;
+}
+
+//NOTE: slices point straight into the loaded files, nothing is copied until glShaderSource
+static bool parseShaderFile(struct ShaderTemplate *shaderTemplate, char *path, int *stage, int depth) {
+    if (depth > SHADER_MAX_INCLUDE_DEPTH || shaderTemplate->fileCount == SHADER_MAX_FILES) {
+        printf("ERROR too many nested includes at %s!\n", path);
+        return false;
+    }
     
-    glCreateBuffers(1, &renderer->ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
+    Buffer file = mapFileIntoBuffer(path);
+    if (!file.data) {
+        printf("ERROR could not read shader %s!\n", path);
+        return false;
+    }
+    shaderTemplate->files[shaderTemplate->fileCount++] = file;
     
-    renderer->buffer = malloc(sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuadsPerBatch);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuadsPerBatch, NULL, GL_DYNAMIC_DRAW);
+    const char *current = (const char *)file.data;
+    const char *end = current + file.size;
+    const char *sliceStart = current;
     
-    u32 *indexBuffer = malloc(sizeof(u32) * INDICIES_PER_QUAD * maxQuadsPerBatch);
-    for (int i = 0, offset = 0; i < INDICIES_PER_QUAD * maxQuadsPerBatch; i += 6) {
-        indexBuffer[i + 0] = offset + 0;
-        indexBuffer[i + 1] = offset + 1;
-        indexBuffer[i + 2] = offset + 2;
+    while (current < end) {
+        const char *lineEnd = memchr(current, '\n', end - current);
+        const char *next = lineEnd ? lineEnd + 1 : end;
+        if (!lineEnd) lineEnd = end;
         
-        indexBuffer[i + 3] = offset + 2;
-        indexBuffer[i + 4] = offset + 3;
-        indexBuffer[i + 5] = offset + 0;
+        const char *line = current;
+        while (line < lineEnd && (*line == ' ' || *line == '\t')) line++;
         
-        offset += 4;
+        if (line < lineEnd && *line == '#') {
+            int newStage = -1;
+            if (lineStartsWith(line, lineEnd, "#VERTEX_SHADER")) newStage = SHADER_STAGE_VERTEX;
+            if (lineStartsWith(line, lineEnd, "#FRAGMENT_SHADER")) newStage = SHADER_STAGE_FRAGMENT;
+            
+            if (newStage != -1) {
+                if (depth > 0) {
+                    printf("ERROR stage markers are not allowed in included file %s!\n", path);
+                    return false;
+                }
+                
+                addShaderSlice(shaderTemplate, *stage, sliceStart, current);
+                *stage = newStage;
+                sliceStart = next;
+            } else if (*stage != -1 && !shaderTemplate->stages[*stage].version && lineStartsWith(line, lineEnd, "#version")) {
+                //the version has to come first, so it is kept apart and variant defines go right after it
+                addShaderSlice(shaderTemplate, *stage, sliceStart, current);
+                shaderTemplate->stages[*stage].version = current;
+                shaderTemplate->stages[*stage].versionLength = (int)(next - current);
+                sliceStart = next;
+            } else if (lineStartsWith(line, lineEnd, "#include")) {
+                const char *nameStart = memchr(line, '"', lineEnd - line);
+                const char *nameEnd = nameStart ? memchr(nameStart + 1, '"', lineEnd - (nameStart + 1)) : NULL;
+                
+                if (!nameEnd) {
+                    printf("ERROR malformed #include in %s!\n", path);
+                    return false;
+                }
+                
+                //there is no stage for the included text to go into yet
+                if (*stage == -1) {
+                    printf("ERROR #include before the first stage marker in %s!\n", path);
+                    return false;
+                }
+                
+                //includes are relative to the including file
+                const char *directoryEnd = path;
+                for (const char *c = path; *c; c++) {
+                    if (*c == '/' || *c == '\\') directoryEnd = c + 1;
+                }
+                
+                char includePath[260];
+                snprintf(includePath, sizeof(includePath), "%.*s%.*s", (int)(directoryEnd - path), path, (int)(nameEnd - nameStart - 1), nameStart + 1);
+                
+                addShaderSlice(shaderTemplate, *stage, sliceStart, current);
+                if (!parseShaderFile(shaderTemplate, includePath, stage, depth + 1)) {
+                    return false;
+                }
+                sliceStart = next;
+            }
+        }
+        
+        current = next;
     }
     
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(u32) * INDICIES_PER_QUAD * maxQuadsPerBatch, indexBuffer, GL_STATIC_DRAW);
-    free(indexBuffer);
+    addShaderSlice(shaderTemplate, *stage, sliceStart, end);
+    return true;
+}
+
+static bool parseShaderTemplate(struct ShaderTemplate *shaderTemplate, char *path) {
+    int stage = -1;
+    shaderTemplate->valid = true;
     
-    return renderer;
+    if (!parseShaderFile(shaderTemplate, path, &stage, 0)) {
+        shaderTemplate->valid = false;
+    }
+    
+    if (shaderTemplate->valid && (!shaderTemplate->stages[SHADER_STAGE_VERTEX].count || !shaderTemplate->stages[SHADER_STAGE_FRAGMENT].count)) {
+        printf("ERROR shader %s needs both a #VERTEX_SHADER and a #FRAGMENT_SHADER section!\n", path);
+        shaderTemplate->valid = false;
+    }
+    
+    return shaderTemplate->valid;
 }
 
-void clearRenderer(vec4 colour) {
-    glClearColor(colour[0], colour[1], colour[2], colour[3]);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+static void freeShaderFiles(struct ShaderTemplate *shaderTemplate) {
+    for (int i = 0; i < shaderTemplate->fileCount; i++) {
+        freeBuffer(&shaderTemplate->files[i]);
+    }
+    shaderTemplate->fileCount = 0;
 }
 
-void drawQuad(struct Renderer *renderer, vec2 position, vec2 size, vec4 colour) {
-    int offset = renderer->currentQuadCount * VERTICES_PER_QUAD;
-    
-    mat4 positionMatrix;
-    glm_mat4_identity(positionMatrix);
-    glm_translate(positionMatrix, (vec3){ position[0], position[1], 0.0f });
+//defines are separated by spaces, "NAME" or "NAME=VALUE"
+static int writeShaderDefines(char *defines, char *out, int outSize) {
+    int length = 0;
     
-    mat4 scaleMatrix;
-    glm_mat4_identity(scaleMatrix);
-    glm_scale(scaleMatrix, (vec3){ size[0], size[1], 1.0f });
+    while (defines && *defines) {
+        while (*defines == ' ') defines++;
+        if (!*defines) break;
+        
+        int nameLength = 0;
+        while (defines[nameLength] && defines[nameLength] != ' ' && defines[nameLength] != '=') nameLength++;
+        
+        int valueLength = 0;
+        char *value = defines + nameLength;
+        if (*value == '=') {
+            value++;
+            while (value[valueLength] && value[valueLength] != ' ') valueLength++;
+        }
+        
+        length += snprintf(out + length, outSize - length, "#define %.*s %.*s\n", nameLength, defines, valueLength, value);
+        if (length >= outSize) {
+            printf("ERROR shader defines \"%s\" are too long!\n", defines);
+            return outSize - 1;
+        }
+        
+        defines = value + valueLength;
+    }
     
-    mat4 transform;
-    glm_mat4_mul(positionMatrix, scaleMatrix, transform);
+    return length;
+}
+
+static struct PendingShader submitShaderVariant(struct ShaderTemplate *shaderTemplate, char *defines) {
+    char defineSource[SHADER_MAX_DEFINES_LENGTH];
+    int defineLength = writeShaderDefines(defines, defineSource, SHADER_MAX_DEFINES_LENGTH);
     
-    //proper screen space geometry
-    vec4 quadVertexPositions[4] = {
-        { 0.0f, 0.0f, 0.0f, 1.0f },
-        { 1.0f, 0.0f, 0.0f, 1.0f },
-        { 1.0f, 1.0f, 0.0f, 1.0f },
-        { 0.0f, 1.0f, 0.0f, 1.0f }
-    };
+    const char *strings[SHADER_STAGE_COUNT][SHADER_MAX_SLICES + 2];
+    int lengths[SHADER_STAGE_COUNT][SHADER_MAX_SLICES + 2];
+    struct ShaderStageSource sources[SHADER_STAGE_COUNT];
     
-    for (int i = 0; i < 4; i++) {
-        vec4 p;
-        glm_mat4_mulv(transform, quadVertexPositions[i], p);
+    for (int stage = 0; stage < SHADER_STAGE_COUNT; stage++) {
+        struct ShaderStageSlices *slices = &shaderTemplate->stages[stage];
+        int count = 0;
         
-        //NOTE: a bit verbose but makes more sense than a memcpy
-        renderer->buffer[offset + i].position[0] = p[0];
-        renderer->buffer[offset + i].position[1] = p[1];
-        renderer->buffer[offset + i].position[2] = p[2];
-        renderer->buffer[offset + i].position[3] = p[3];
+        if (slices->version) {
+            strings[stage][count] = slices->version;
+            lengths[stage][count++] = slices->versionLength;
+        }
+        
+        strings[stage][count] = defineSource;
+        lengths[stage][count++] = defineLength;
         
-        renderer->buffer[offset + i].colour[0] = colour[0];
-        renderer->buffer[offset + i].colour[1] = colour[1];
-        renderer->buffer[offset + i].colour[2] = colour[2];
-        renderer->buffer[offset + i].colour[3] = colour[3];
+        for (int i = 0; i < slices->count; i++) {
+            strings[stage][count] = slices->data[i];
+            lengths[stage][count++] = slices->lengths[i];
+        }
         
-        renderer->buffer[offset + i].textureIndex = -1.0f;
+        sources[stage] = (struct ShaderStageSource) { count, strings[stage], lengths[stage] };
     }
     
-    renderer->currentQuadCount++;
-    if (renderer->currentQuadCount == renderer->maxQuadsPerBatch) {
-        flushRenderer(renderer);
+    return submitShader(sources[SHADER_STAGE_VERTEX], sources[SHADER_STAGE_FRAGMENT]);
+}
+
+static struct Shader compileShaderVariant(struct ShaderTemplate *shaderTemplate, char *defines) {
+    struct PendingShader pending = submitShaderVariant(shaderTemplate, defines);
+    return resolveShader(&pending);
+}
+
+static u32 hashString(char *string) {
+    u32 hash = 2166136261u;
+    while (string && *string) {
+        hash ^= (u8)*string++;
+        hash *= 16777619u;
     }
+    return hash;
 }
 
-void drawTexture(struct Renderer *renderer, struct Texture texture, vec2 position, vec2 scale) {
-    int offset = renderer->currentQuadCount * VERTICES_PER_QUAD;
-    
-    mat4 positionMatrix;
-    glm_mat4_identity(positionMatrix);
-    glm_translate(positionMatrix, (vec3){ position[0], position[1], 0.0f });
+struct ShaderTemplate *loadShaderTemplate(char *path) {
+    struct ShaderTemplate *shaderTemplate = malloc(sizeof(struct ShaderTemplate));
+    memset(shaderTemplate, 0, sizeof(struct ShaderTemplate));
     
-    mat4 scaleMatrix;
-    glm_mat4_identity(scaleMatrix);
-    glm_scale(scaleMatrix, (vec3){ texture.width * scale[0], texture.height * scale[1], 1.0f });
-    
-    mat4 transform;
-    glm_mat4_mul(positionMatrix, scaleMatrix, transform);
+    if (!parseShaderTemplate(shaderTemplate, path)) {
+        freeShaderFiles(shaderTemplate);
+    }
     
-    //proper screen space geometry
-    vec4 quadVertexPositions[4] = {
-        { 0.0f, 0.0f, 0.0f, 1.0f },
-        { 1.0f, 0.0f, 0.0f, 1.0f },
-        { 1.0f, 1.0f, 0.0f, 1.0f },
-        { 0.0f, 1.0f, 0.0f, 1.0f }
-    };
+    return shaderTemplate;
+}
+
+struct Shader getShaderVariant(struct ShaderTemplate *shaderTemplate, char *defines) {
+    if (!shaderTemplate->valid) {
+        return NO_SHADER;
+    }
     
-    vec2 quadTextureCoordinates[4] = {
-        { 0.0f, 0.0f },
-        { 1.0f, 0.0f },
-        { 1.0f, 1.0f },
-        { 0.0f, 1.0f }
-    };
+    if (!defines) defines = "";
+    u32 hash = hashString(defines);
     
-    //TODO: do we want to use a pointer to the texture or just pass the whole struct?
-    float textureIndex = -1.0f;
-    for (int i = 0; i < RENDERER_TEXTURE_SLOTS; i++) {
-        if (renderer->textureSlots[i].id == texture.id) {
-            textureIndex = (float)i;
+    for (int i = 0; i < shaderTemplate->variantCount; i++) {
+        struct ShaderVariant *variant = &shaderTemplate->variants[i];
+        if (variant->hash == hash && strcmp(variant->defines, defines) == 0) {
+            return variant->shader;
         }
     }
     
-    if (textureIndex == -1.0f) {
-        textureIndex = (float)renderer->currentTextureIndex;
-        renderer->textureSlots[renderer->currentTextureIndex++] = texture;
+    if (shaderTemplate->variantCount == SHADER_MAX_VARIANTS || strlen(defines) >= SHADER_MAX_DEFINES_LENGTH) {
+        printf("ERROR cannot cache shader variant \"%s\"!\n", defines);
+        return NO_SHADER;
     }
     
-    for (int i = 0; i < 4; i++) {
-        vec4 p;
-        glm_mat4_mulv(transform, quadVertexPositions[i], p);
-        
-        //NOTE: a bit verbose but makes more sense than a memcpy
-        renderer->buffer[offset + i].position[0] = p[0];
-        renderer->buffer[offset + i].position[1] = p[1];
-        renderer->buffer[offset + i].position[2] = p[2];
-        renderer->buffer[offset + i].position[3] = p[3];
-        
-        renderer->buffer[offset + i].colour[0] = 1.0f;
-        renderer->buffer[offset + i].colour[1] = 1.0f;
-        renderer->buffer[offset + i].colour[2] = 1.0f;
-        renderer->buffer[offset + i].colour[3] = 1.0f;
-        
-        renderer->buffer[offset + i].textureCoordinates[0] = quadTextureCoordinates[i][0];
-        renderer->buffer[offset + i].textureCoordinates[1] = quadTextureCoordinates[i][1];
-        
-        renderer->buffer[offset + i].textureIndex = textureIndex;
-    }
+    struct ShaderVariant *variant = &shaderTemplate->variants[shaderTemplate->variantCount++];
+    variant->hash = hash;
+    strcpy(variant->defines, defines);
+    variant->shader = compileShaderVariant(shaderTemplate, defines);
     
-    renderer->currentQuadCount++;
-    if (renderer->currentQuadCount == renderer->maxQuadsPerBatch) {
-        flushRenderer(renderer);
+    return variant->shader;
+}
+
+void freeShaderTemplate(struct ShaderTemplate *shaderTemplate) {
+    for (int i = 0; i < shaderTemplate->variantCount; i++) {
+        glDeleteProgram(shaderTemplate->variants[i].shader.id);
+        forgetDeletedProgram(shaderTemplate->variants[i].shader.id);
     }
+    
+    freeShaderFiles(shaderTemplate);
+    free(shaderTemplate);
 }
 
-void flushRenderer(struct Renderer *renderer) {
-    int bufferSize = sizeof(struct Vertex) * VERTICES_PER_QUAD * renderer->currentQuadCount;
-    int elementCount = INDICIES_PER_QUAD * renderer->currentQuadCount;
+struct Shader loadShader(char *path) {
+    struct ShaderTemplate shaderTemplate = { 0 };
+    struct Shader shader = NO_SHADER;
     
-    for (int i = 0; i < renderer->currentTextureIndex; i++) {
-        struct Texture texture = renderer->textureSlots[i];
-        glBindTextureUnit(i, texture.id);
+    if (parseShaderTemplate(&shaderTemplate, path)) {
+        shader = compileShaderVariant(&shaderTemplate, "");
     }
     
-    glBufferSubData(GL_ARRAY_BUFFER, 0, bufferSize, renderer->buffer);
-    glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, NULL);
+    freeShaderFiles(&shaderTemplate);
     
-    renderer->currentQuadCount = 0;
-    renderer->currentTextureIndex = 0;
+    return shader;
 }
 
-struct Image loadImage(char *path) {
-    struct Image image = { 0 };
+#define SHADER_BATCH_MAX_SHADERS 32
+
+struct ShaderBatch {
+    struct PendingShader pending[SHADER_BATCH_MAX_SHADERS];
+    struct Shader *results[SHADER_BATCH_MAX_SHADERS];
+    int count;
+    int resolvedCount;
+};
+
+struct ShaderBatch *beginShaderBatch(void) {
+    struct ShaderBatch *batch = malloc(sizeof(struct ShaderBatch));
+    memset(batch, 0, sizeof(struct ShaderBatch));
+    
+    return batch;
+}
+
+void addShaderToBatch(struct ShaderBatch *batch, char *path, struct Shader *shader) {
+    *shader = NO_SHADER;
+    
+    //without the extension the first status query would stall anyway, so just compile in order
+    if (!hasParallelShaderCompile() || batch->count == SHADER_BATCH_MAX_SHADERS) {
+        *shader = loadShader(path);
+        return;
+    }
+    
+    struct ShaderTemplate shaderTemplate = { 0 };
+    
+    if (parseShaderTemplate(&shaderTemplate, path)) {
+        //glShaderSource keeps its own copy, so the files can go as soon as everything is submitted
+        batch->pending[batch->count] = submitShaderVariant(&shaderTemplate, "");
+        batch->results[batch->count] = shader;
+        batch->count++;
+    }
+    
+    freeShaderFiles(&shaderTemplate);
+}
+
+bool pollShaderBatch(struct ShaderBatch *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        struct PendingShader *pending = &batch->pending[i];
+        
+        if (pending->program && isShaderReady(pending)) {
+            *batch->results[i] = resolveShader(pending);
+            batch->resolvedCount++;
+        }
+    }
+    
+    return batch->resolvedCount == batch->count;
+}
+
+void finishShaderBatch(struct ShaderBatch *batch) {
+    PROFILE_BEGIN("finishShaderBatch");
+    
+    for (int i = 0; i < batch->count; i++) {
+        struct PendingShader *pending = &batch->pending[i];
+        
+        if (pending->program) {
+            *batch->results[i] = resolveShader(pending);
+        }
+    }
+    
+    free(batch);
+    PROFILE_END();
+}
+
+void useShader(struct Shader shader) {
+    useProgram(shader.id);
+}
+
+void setShaderMat4(struct Shader shader, char *uniform, mat4 matrix) {
+    int location = glGetUniformLocation(shader.id, uniform);
+    glUniformMatrix4fv(location, 1, GL_FALSE, &matrix[0][0]);
+}
+
+struct Vertex {
+    vec4 position;
+    u32 colour;
+    
+    vec2 textureCoordinates;
+    float textureIndex;
+    float palette;
+    float camera;
+    float blendMode;
+};
+
+#define VERTICES_PER_QUAD 4
+#define INDICIES_PER_QUAD 6
+
+//NOTE: the last texture unit is reserved for the palette texture
+#define RENDERER_TEXTURE_SLOTS 31
+#define RENDERER_PALETTE_SLOT 31
+
+//uniform buffer binding of the camera block in the shaders
+#define RENDERER_CAMERA_BINDING 0
+
+//uniform location of u_usedSize in the SHARP_BILINEAR variant
+#define SHARP_BILINEAR_USED_SIZE_LOCATION 0
+
+//shader storage binding of the sprite records under VERTEX_PULLING
+#define RENDERER_SPRITE_BINDING 1
+
+//uniform location of u_depthOffset in the VERTEX_PULLING variants
+#define SPRITE_DEPTH_OFFSET_LOCATION 3
+
+struct QuadSortKey {
+    float depth;
+    u32 quad;
+};
+
+#define DEBUG_OVERDRAW 1
+#define DEBUG_TINT 2
+
+//uniform locations of u_debugMode and u_debugColour in the DEBUG variants
+#define DEBUG_MODE_LOCATION 1
+#define DEBUG_COLOUR_LOCATION 2
+
+//matches DrawElementsIndirectCommand
+struct DrawCommand {
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    i32 baseVertex;
+    u32 baseInstance;
+};
+
+//what a quad looked like last frame for partial redraw, bounds are window pixels (left, bottom, right, top)
+struct QuadDamage {
+    u32 hash;
+    int bounds[4];
+};
+
+struct Renderer {
+    u32 maxQuadsPerBatch;
+    
+    u32 vao;
+    u32 vbo;
+    u32 ibo;
+    
+    struct Vertex *buffer;
+    u32 currentQuadCount;
+    
+    struct Texture textureSlots[RENDERER_TEXTURE_SLOTS];
+    int currentTextureIndex;
+    
+    u32 paletteTexture;
+    int paletteCount;
+    
+    //rows given back by freePalette, handed out again before new ones
+    int freePalettes[RENDERER_MAX_PALETTES];
+    int freePaletteCount;
+    
+    u32 cameraBuffer;
+    int currentCamera;
+    
+    struct Shader currentShader;
+    enum BlendMode currentBlendMode;
+    
+    //the layer as a vertex z, see setRendererLayer
+    float currentDepth;
+    
+    //batches drawn since the depth buffer was last cleared, each one sits a step nearer
+    u32 depthSequence;
+    
+    //quads are written in submission order and sorted into drawBuffer per pass when flushed
+    struct Vertex *drawBuffer;
+    struct QuadSortKey *opaqueQuads;
+    u32 opaqueQuadCount;
+    struct QuadSortKey *translucentQuads;
+    u32 translucentQuadCount;
+    int translucentBlendGroup;
+    
+    enum RendererDebugMode debugMode;
+    struct Shader debugShader;
+    u32 batchIndex;
+    
+    //the scissor asked for, partial redraw narrows it to the damage when a batch is drawn
+    bool scissorEnabled;
+    int scissor[4];
+    
+    //partial redraw, cpu copies of the cameras so quads can be placed on screen
+    mat4 cameras[RENDERER_MAX_CAMERAS];
+    
+    bool partialRedraw;
+    bool presenting;
+    struct RenderTarget frameCache;
+    int frameWidth;
+    int frameHeight;
+    
+    struct QuadDamage *frameQuads;
+    struct QuadDamage *previousFrameQuads;
+    u32 frameQuadCount;
+    u32 previousFrameQuadCount;
+    u32 maxFrameQuads;
+    
+    int damage[4];
+    bool clearPending;
+    vec4 frameClearColour;
+    
+    //multi draw, batches waiting in multiDrawVbo for one indirect draw per pass. everything queued shares
+    //queuedProgram, and queuedBlendGroup when any of it is translucent
+    bool multiDraw;
+    u32 multiDrawVao;
+    u32 multiDrawVbo;
+    u32 indirectBuffer;
+    u32 clipRectBuffer;
+    u32 maxQueuedQuads;
+    u32 maxQueuedDraws;
+    
+    struct DrawCommand *opaqueDraws;
+    vec4 *opaqueClipRects;
+    u32 queuedOpaqueCount;
+    struct DrawCommand *translucentDraws;
+    vec4 *translucentClipRects;
+    u32 queuedTranslucentCount;
+    
+    u32 queuedQuadCount;
+    u32 queuedProgram;
+    int queuedBlendGroup;
+    enum FlushReason queuedReason;
+    
+    //sprite buffers read no attributes, gl still wants a vertex array bound for the draw
+    u32 spriteVao;
+    
+    //what beginRenderTarget is drawing into and the window viewport to go back to
+    struct RenderTarget *currentTarget;
+    int viewport[4];
+    
+    struct RendererStats stats;
+};
+
+static struct Renderer g_renderer;
+
+#ifdef SALAMANDER_DEBUG
+void errorCallback(u32 source, u32 type, u32 id, u32 severity, int length, const char* message, const void* userParam) {
+    char *typeString = (type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : "");
+    printf("GL CALLBACK: %s type = 0x%x, severity = 0x%x, message = %s\n", typeString, type, severity, message );
+}
+#endif
+
+//reads from whatever buffer is bound to GL_ARRAY_BUFFER, which has to be vertexArray's
+static void setQuadVertexAttributes(u32 vertexArray) {
+    glEnableVertexArrayAttrib(vertexArray, 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, position));
+    
+    glEnableVertexArrayAttrib(vertexArray, 1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, colour));
+    
+    glEnableVertexArrayAttrib(vertexArray, 2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, textureCoordinates));
+    
+    glEnableVertexArrayAttrib(vertexArray, 3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, textureIndex));
+    
+    glEnableVertexArrayAttrib(vertexArray, 4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, palette));
+    
+    glEnableVertexArrayAttrib(vertexArray, 5);
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, camera));
+    
+    glEnableVertexArrayAttrib(vertexArray, 6);
+    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (const void *)offsetof(struct Vertex, blendMode));
+}
+
+//per draw clip rect for multi draw, a constant that never clips everywhere else. the planes are only enabled for
+//draws that clip with it, straight draws leave clipping to gl's scissor. anything past [-1, 1] is off screen anyway,
+//a finite rect keeps the clip distances finite
+#define CLIP_ATTRIBUTE 7
+#define NO_CLIP_RECT (vec4){ -2.0f, -2.0f, 2.0f, 2.0f }
+
+//the scissor in pixels of whatever is bound (x, y, width, height). inside a target it was given in the target's
+//pixels at full size, the cameras still cover all of it so it shrinks with the used part like the picture does
+static void getScissorRect(struct Renderer *renderer, int *rect) {
+    int *scissor = renderer->scissor;
+    struct RenderTarget *target = renderer->currentTarget;
+    if (!target) {
+        memcpy(rect, scissor, sizeof(renderer->scissor));
+        return;
+    }
+    
+    float scaleX = (float)target->usedWidth / target->texture.width;
+    float scaleY = (float)target->usedHeight / target->texture.height;
+    rect[0] = (int)floorf(scissor[0] * scaleX + 0.5f);
+    rect[1] = (int)floorf(scissor[1] * scaleY + 0.5f);
+    rect[2] = (int)floorf((scissor[0] + scissor[2]) * scaleX + 0.5f) - rect[0];
+    rect[3] = (int)floorf((scissor[1] + scissor[3]) * scaleY + 0.5f) - rect[1];
+}
+
+//the scissor in normalized device coordinates of the viewport of whatever is bound
+static void getClipRect(struct Renderer *renderer, vec4 clipRect) {
+    if (!renderer->scissorEnabled) {
+        glm_vec4_copy(NO_CLIP_RECT, clipRect);
+        return;
+    }
+    
+    struct RenderTarget *target = renderer->currentTarget;
+    int *viewport = target ? (int[4]){ 0, 0, target->usedWidth, target->usedHeight } : renderer->viewport;
+    
+    int rect[4];
+    getScissorRect(renderer, rect);
+    clipRect[0] = (float)(rect[0] - viewport[0]) / viewport[2] * 2.0f - 1.0f;
+    clipRect[1] = (float)(rect[1] - viewport[1]) / viewport[3] * 2.0f - 1.0f;
+    clipRect[2] = (float)(rect[0] + rect[2] - viewport[0]) / viewport[2] * 2.0f - 1.0f;
+    clipRect[3] = (float)(rect[1] + rect[3] - viewport[1]) / viewport[3] * 2.0f - 1.0f;
+}
+
+struct Renderer *createRenderer(struct Arena *arena, int maxQuadsPerBatch) {
+    struct Renderer *renderer = &g_renderer;
+    renderer->maxQuadsPerBatch = maxQuadsPerBatch;
+    
+#ifdef SALAMANDER_DEBUG
+    glEnable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(errorCallback, 0);
+#endif
+    
+    glCreateVertexArrays(1, &renderer->vao);
+    bindVertexArray(renderer->vao);
+    
+    glCreateBuffers(1, &renderer->vbo);
+    bindArrayBuffer(renderer->vbo);
+    
+    setQuadVertexAttributes(renderer->vao);
+    
+    //the element buffer binding is part of the vertex array, so it never needs rebinding
+    glCreateBuffers(1, &renderer->ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
+    
+    renderer->buffer = arenaAlloc(arena, sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuadsPerBatch);
+    renderer->drawBuffer = arenaAlloc(arena, sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuadsPerBatch);
+    renderer->opaqueQuads = arenaAlloc(arena, sizeof(struct QuadSortKey) * maxQuadsPerBatch);
+    renderer->translucentQuads = arenaAlloc(arena, sizeof(struct QuadSortKey) * maxQuadsPerBatch);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuadsPerBatch, NULL, GL_DYNAMIC_DRAW);
+    TRACK_GPU_ALLOCATION("gl buffer", sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuadsPerBatch);
+    
+    //the indices only need to live until they are uploaded
+    struct ArenaMarker marker = getArenaMarker(arena);
+    u32 *indexBuffer = arenaAlloc(arena, sizeof(u32) * INDICIES_PER_QUAD * maxQuadsPerBatch);
+    for (int i = 0, offset = 0; i < INDICIES_PER_QUAD * maxQuadsPerBatch; i += 6) {
+        indexBuffer[i + 0] = offset + 0;
+        indexBuffer[i + 1] = offset + 1;
+        indexBuffer[i + 2] = offset + 2;
+        
+        indexBuffer[i + 3] = offset + 2;
+        indexBuffer[i + 4] = offset + 3;
+        indexBuffer[i + 5] = offset + 0;
+        
+        offset += 4;
+    }
+    
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(u32) * INDICIES_PER_QUAD * maxQuadsPerBatch, indexBuffer, GL_STATIC_DRAW);
+    TRACK_GPU_ALLOCATION("gl buffer", sizeof(u32) * INDICIES_PER_QUAD * maxQuadsPerBatch);
+    resetArenaToMarker(arena, marker);
+    
+    glCreateTextures(GL_TEXTURE_2D, 1, &renderer->paletteTexture);
+    glTextureStorage2D(renderer->paletteTexture, 1, GL_RGBA8, PALETTE_SIZE, RENDERER_MAX_PALETTES);
+    TRACK_GPU_ALLOCATION("gl texture", PALETTE_SIZE * RENDERER_MAX_PALETTES * 4);
+    
+    glTextureParameteri(renderer->paletteTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(renderer->paletteTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(renderer->paletteTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(renderer->paletteTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    renderer->currentShader = NO_SHADER;
+    renderer->currentBlendMode = BLEND_ALPHA;
+    
+    glGetIntegerv(GL_VIEWPORT, renderer->viewport);
+    
+    glCreateVertexArrays(1, &renderer->spriteVao);
+    
+    //current attribute values are context state, vertex arrays without the clip attribute all read this
+    glVertexAttrib4fv(CLIP_ATTRIBUTE, NO_CLIP_RECT);
+    
+    //cameras nobody set draw nothing rather than garbage
+    mat4 cameras[RENDERER_MAX_CAMERAS] = { 0 };
+    
+    glCreateBuffers(1, &renderer->cameraBuffer);
+    glNamedBufferStorage(renderer->cameraBuffer, sizeof(cameras), cameras, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_UNIFORM_BUFFER, RENDERER_CAMERA_BINDING, renderer->cameraBuffer);
+    TRACK_GPU_ALLOCATION("gl buffer", sizeof(cameras));
+    
+    return renderer;
+}
+
+static void flushBatch(struct Renderer *renderer, enum FlushReason reason);
+static void submitQueuedDraws(struct Renderer *renderer);
+
+//multi draw queues every batch, partial redraw holds the frame's batches in the same queue until present when
+//the buffers for it exist, so the damage is known before any of them is drawn
+static bool isQueueingBatches(struct Renderer *renderer) {
+    return renderer->multiDraw || (renderer->partialRedraw && !renderer->currentTarget && renderer->multiDrawVao);
+}
+
+//puts the scissor into gl when batches are drawn straight away, queued ones clip themselves and in the window
+//partial redraw narrows it to the damage per batch
+static void applyRendererScissor(struct Renderer *renderer) {
+    if (isQueueingBatches(renderer) || (renderer->partialRedraw && !renderer->currentTarget)) return;
+    
+    int rect[4];
+    getScissorRect(renderer, rect);
+    setScissorEnabled(renderer->scissorEnabled);
+    setScissorRect(rect[0], rect[1], rect[2], rect[3]);
+}
+
+static void damageEverything(struct Renderer *renderer) {
+    renderer->damage[0] = 0;
+    renderer->damage[1] = 0;
+    renderer->damage[2] = renderer->frameWidth;
+    renderer->damage[3] = renderer->frameHeight;
+}
+
+void clearRenderer(vec4 colour) {
+    //the heatmap only reads right on black
+    vec4 black = { 0.0f, 0.0f, 0.0f, 1.0f };
+    float *clearColour = (g_renderer.debugMode == RENDERER_DEBUG_OVERDRAW) ? black : colour;
+    
+    //queued draws belong before the clear
+    submitQueuedDraws(&g_renderer);
+    g_renderer.depthSequence = 0;
+    
+    //the clear has to wait for the first batch to know what changed
+    if (g_renderer.partialRedraw) {
+        if (!glm_vec4_eqv(clearColour, g_renderer.frameClearColour)) {
+            damageEverything(&g_renderer);
+        }
+        glm_vec4_copy(clearColour, g_renderer.frameClearColour);
+        g_renderer.clearPending = true;
+        return;
+    }
+    
+    bindDrawFramebuffer(0);
+    setClearColour(clearColour);
+    
+    //glClear respects the depth mask, the translucent pass leaves it off
+    setDepthWrite(true);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void setRendererCamera(struct Renderer *renderer, int camera, mat4 viewProjection) {
+    assert(camera >= 0 && camera < RENDERER_MAX_CAMERAS);
+    //queued batches were recorded against the old matrix
+    submitQueuedDraws(renderer);
+    
+    glNamedBufferSubData(renderer->cameraBuffer, sizeof(mat4) * camera, sizeof(mat4), &viewProjection[0][0]);
+    glm_mat4_copy(viewProjection, renderer->cameras[camera]);
+}
+
+//modes that share gl blend state can share a batch
+static int getBlendGroup(enum BlendMode blendMode) {
+    switch (blendMode) {
+        case BLEND_OPAQUE: return 0;
+        case BLEND_MULTIPLY: return 2;
+        default: return 1;
+    }
+}
+
+static void applyBlendGroup(int blendGroup) {
+    switch (blendGroup) {
+        case 0: {
+            setBlendEnabled(false);
+        } break;
+        
+        case 1: {
+            setBlendEnabled(true);
+            setBlendFunction(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        } break;
+        
+        case 2: {
+            //dst * src + dst * (1 - src alpha), with a premultiplied source transparent texels leave dst alone
+            setBlendEnabled(true);
+            setBlendFunction(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA);
+        } break;
+    }
+}
+
+void setRendererShader(struct Renderer *renderer, struct Shader shader) {
+    if (shader.id != renderer->currentShader.id) {
+        flushBatch(renderer, FLUSH_STATE_CHANGE);
+        renderer->currentShader = shader;
+    }
+}
+
+void setRendererBlendMode(struct Renderer *renderer, enum BlendMode blendMode) {
+    //opaque quads have their own pass, only translucent ones that blend differently need a new batch
+    int blendGroup = getBlendGroup(blendMode);
+    if (blendGroup != 0 && renderer->translucentQuadCount > 0 && blendGroup != renderer->translucentBlendGroup) {
+        flushBatch(renderer, FLUSH_STATE_CHANGE);
+    }
+    renderer->currentBlendMode = blendMode;
+}
+
+//NOTE: with the [-1, 1] ortho cameras z -1 lands on depth 1.0, which fails GL_LESS against the cleared depth,
+//so layers are squeezed in from both ends before they become a z
+#define LAYER_DEPTH_SCALE (1.0f - 1.0f / 1024.0f)
+
+//NOTE: sorting only orders a layer within one batch, so every batch of the frame is also drawn a step nearer than
+//the one before and same layer quads keep submission order across flushes. a step is 8 units of a 24 bit depth
+//buffer and all of them fit in the headroom the scale leaves at the near end. layers closer together than the
+//steps a frame uses (1/1048576 per batch) can swap, past the last step batches tie like they do within a layer
+#define DEPTH_SEQUENCE_STEP (1.0f / 1048576.0f)
+#define DEPTH_SEQUENCE_STEPS 1024
+
+static float getSequenceDepth(struct Renderer *renderer) {
+    return (float)renderer->depthSequence * DEPTH_SEQUENCE_STEP;
+}
+
+static void advanceDepthSequence(struct Renderer *renderer) {
+    if (renderer->depthSequence < DEPTH_SEQUENCE_STEPS - 1) {
+        renderer->depthSequence++;
+    }
+}
+
+void setRendererLayer(struct Renderer *renderer, float layer) {
+    renderer->currentDepth = glm_clamp(layer, -1.0f, 1.0f) * LAYER_DEPTH_SCALE;
+}
+
+void setRendererMaterial(struct Renderer *renderer, struct Material material) {
+    setRendererShader(renderer, material.shader);
+    setRendererBlendMode(renderer, material.blendMode);
+}
+
+void useRendererCamera(struct Renderer *renderer, int camera) {
+    assert(camera >= 0 && camera < RENDERER_MAX_CAMERAS);
+    renderer->currentCamera = camera;
+}
+
+//slots outlive flushes so a texture keeps its unit and the rebind is elided, they only start over once full
+static float getTextureSlot(struct Renderer *renderer, struct Texture texture) {
+    //TODO: do we want to use a pointer to the texture or just pass the whole struct?
+    for (int i = 0; i < renderer->currentTextureIndex; i++) {
+        if (renderer->textureSlots[i].id == texture.id) {
+            return (float)i;
+        }
+    }
+    
+    if (renderer->currentTextureIndex == RENDERER_TEXTURE_SLOTS) {
+        flushBatch(renderer, FLUSH_TEXTURE_SLOTS);
+        submitQueuedDraws(renderer);
+        renderer->currentTextureIndex = 0;
+    }
+    
+    renderer->textureSlots[renderer->currentTextureIndex] = texture;
+    return (float)renderer->currentTextureIndex++;
+}
+
+//origin is the pivot as a fraction of size, it lands on position and the quad rotates around it
+static void pushQuad(struct Renderer *renderer, vec2 position, vec2 size, vec2 origin, float sine, float cosine,
+                     vec4 uv, u32 colours[4], float textureIndex, float palette) {
+    struct Vertex *vertices = &renderer->buffer[renderer->currentQuadCount * VERTICES_PER_QUAD];
+    float depth = renderer->currentDepth + getSequenceDepth(renderer);
+    
+    float left = -origin[0] * size[0];
+    float top = -origin[1] * size[1];
+    float right = left + size[0];
+    float bottom = top + size[1];
+    
+    //proper screen space geometry
+    vec2 corners[4] = {
+        { left, top },
+        { right, top },
+        { right, bottom },
+        { left, bottom }
+    };
+    
+    vec2 textureCoordinates[4] = {
+        { uv[0], uv[1] },
+        { uv[2], uv[1] },
+        { uv[2], uv[3] },
+        { uv[0], uv[3] }
+    };
+    
+    for (int i = 0; i < 4; i++) {
+        struct Vertex *vertex = &vertices[i];
+        
+        vertex->position[0] = position[0] + corners[i][0] * cosine - corners[i][1] * sine;
+        vertex->position[1] = position[1] + corners[i][0] * sine + corners[i][1] * cosine;
+        vertex->position[2] = depth;
+        vertex->position[3] = 1.0f;
+        
+        vertex->colour = colours[i];
+        
+        vertex->textureCoordinates[0] = textureCoordinates[i][0];
+        vertex->textureCoordinates[1] = textureCoordinates[i][1];
+        
+        vertex->textureIndex = textureIndex;
+        vertex->palette = palette;
+        vertex->camera = (float)renderer->currentCamera;
+        vertex->blendMode = (float)renderer->currentBlendMode;
+    }
+    
+    struct QuadSortKey key = { renderer->currentDepth, renderer->currentQuadCount };
+    int blendGroup = getBlendGroup(renderer->currentBlendMode);
+    
+    if (blendGroup == 0) {
+        renderer->opaqueQuads[renderer->opaqueQuadCount++] = key;
+    } else {
+        renderer->translucentQuads[renderer->translucentQuadCount++] = key;
+        renderer->translucentBlendGroup = blendGroup;
+    }
+    
+    renderer->currentQuadCount++;
+    if (renderer->currentQuadCount == renderer->maxQuadsPerBatch) {
+        flushBatch(renderer, FLUSH_BUFFER_FULL);
+    }
+}
+
+static void getSourceUVs(vec4 sourceRect, int flip, vec4 uv) {
+    uv[0] = (flip & SPRITE_FLIP_X) ? sourceRect[2] : sourceRect[0];
+    uv[2] = (flip & SPRITE_FLIP_X) ? sourceRect[0] : sourceRect[2];
+    uv[1] = (flip & SPRITE_FLIP_Y) ? sourceRect[3] : sourceRect[1];
+    uv[3] = (flip & SPRITE_FLIP_Y) ? sourceRect[1] : sourceRect[3];
+}
+
+u32 packColour(vec4 colour) {
+    u32 channels[4];
+    for (int i = 0; i < 4; i++) {
+        channels[i] = (u32)(glm_clamp(colour[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+    
+    return PACK_COLOUR(channels[0], channels[1], channels[2], channels[3]);
+}
+
+#define SOLID_COLOURS(c) ((u32[4]){ (c), (c), (c), (c) })
+
+void drawQuad(struct Renderer *renderer, vec2 position, vec2 size, vec4 colour) {
+    drawQuadPacked(renderer, position, size, packColour(colour));
+}
+
+void drawQuadPacked(struct Renderer *renderer, vec2 position, vec2 size, u32 colour) {
+    pushQuad(renderer, position, size, (vec2){ 0.0f, 0.0f }, 0.0f, 1.0f, FULL_SOURCE_RECT, SOLID_COLOURS(colour), -1.0f, -1.0f);
+}
+
+void drawQuadGradient(struct Renderer *renderer, vec2 position, vec2 size, u32 colours[4]) {
+    pushQuad(renderer, position, size, (vec2){ 0.0f, 0.0f }, 0.0f, 1.0f, FULL_SOURCE_RECT, colours, -1.0f, -1.0f);
+}
+
+void drawQuadEx(struct Renderer *renderer, vec2 position, vec2 size, vec2 origin, float rotation, vec4 colour) {
+    pushQuad(renderer, position, size, origin, sinf(rotation), cosf(rotation), FULL_SOURCE_RECT, SOLID_COLOURS(packColour(colour)), -1.0f, -1.0f);
+}
+
+//rendered textures come out bottom row first
+static int getTextureFlip(struct Texture texture) {
+    return texture.flipY ? SPRITE_FLIP_Y : SPRITE_FLIP_NONE;
+}
+
+static float getTexturePalette(struct Texture texture) {
+    return (texture.format == TEXTURE_FORMAT_INDEXED8) ? (float)texture.palette : -1.0f;
+}
+
+void drawTexture(struct Renderer *renderer, struct Texture texture, vec2 position, vec2 scale) {
+    drawTextureTinted(renderer, texture, position, scale, COLOUR_WHITE);
+}
+
+void drawTextureTinted(struct Renderer *renderer, struct Texture texture, vec2 position, vec2 scale, u32 tint) {
+    vec2 size = { texture.width * scale[0], texture.height * scale[1] };
+    
+    vec4 uv;
+    getSourceUVs(FULL_SOURCE_RECT, getTextureFlip(texture), uv);
+    
+    pushQuad(renderer, position, size, (vec2){ 0.0f, 0.0f }, 0.0f, 1.0f, uv, SOLID_COLOURS(tint),
+             getTextureSlot(renderer, texture), getTexturePalette(texture));
+}
+
+void drawTextureEx(struct Renderer *renderer, struct Texture texture, vec2 position, vec2 scale, vec2 origin, float rotation,
+                   vec4 sourceRect, int flip) {
+    //the drawn size follows the part of the texture being drawn, so atlas frames keep their pixel size
+    vec2 size = {
+        texture.width * (sourceRect[2] - sourceRect[0]) * scale[0],
+        texture.height * (sourceRect[3] - sourceRect[1]) * scale[1]
+    };
+    
+    vec4 uv;
+    getSourceUVs(sourceRect, flip ^ getTextureFlip(texture), uv);
+    
+    pushQuad(renderer, position, size, origin, sinf(rotation), cosf(rotation), uv, SOLID_COLOURS(COLOUR_WHITE),
+             getTextureSlot(renderer, texture), getTexturePalette(texture));
+}
+
+#define SPRITE_CHUNK_SIZE 64
+
+void drawSprites(struct Renderer *renderer, struct Texture texture, struct Sprite *sprites, int count) {
+    float palette = getTexturePalette(texture);
+    float textureIndex = getTextureSlot(renderer, texture);
+    int textureFlip = getTextureFlip(texture);
+    
+    //rotations are turned into sines and cosines a chunk at a time, the vector path wants them side by side
+    float angles[SPRITE_CHUNK_SIZE];
+    float sines[SPRITE_CHUNK_SIZE];
+    float cosines[SPRITE_CHUNK_SIZE];
+    
+    for (int start = 0; start < count; start += SPRITE_CHUNK_SIZE) {
+        int chunkCount = (count - start < SPRITE_CHUNK_SIZE) ? count - start : SPRITE_CHUNK_SIZE;
+        
+        for (int i = 0; i < chunkCount; i++) {
+            angles[i] = sprites[start + i].rotation;
+        }
+        sinCosBulk(angles, sines, cosines, chunkCount);
+        
+        for (int i = 0; i < chunkCount; i++) {
+            struct Sprite *sprite = &sprites[start + i];
+            
+            vec2 size = {
+                texture.width * (sprite->sourceRect[2] - sprite->sourceRect[0]) * sprite->scale[0],
+                texture.height * (sprite->sourceRect[3] - sprite->sourceRect[1]) * sprite->scale[1]
+            };
+            
+            vec4 uv;
+            getSourceUVs(sprite->sourceRect, sprite->flip ^ textureFlip, uv);
+            
+            pushQuad(renderer, sprite->position, size, sprite->origin, sines[i], cosines[i], uv, SOLID_COLOURS(COLOUR_WHITE),
+                     textureIndex, palette);
+        }
+    }
+}
+
+void drawIndexedTexture(struct Renderer *renderer, struct Texture texture, int palette, vec2 position, vec2 scale) {
+    assert(texture.format == TEXTURE_FORMAT_INDEXED8);
+    vec2 size = { texture.width * scale[0], texture.height * scale[1] };
+    
+    pushQuad(renderer, position, size, (vec2){ 0.0f, 0.0f }, 0.0f, 1.0f, FULL_SOURCE_RECT, SOLID_COLOURS(COLOUR_WHITE),
+             getTextureSlot(renderer, texture), (float)palette);
+}
+
+//front to back, and later quads first within a layer so with GL_LESS they still end up on top
+static int compareOpaqueQuads(const void *a, const void *b) {
+    const struct QuadSortKey *left = a;
+    const struct QuadSortKey *right = b;
+    
+    if (left->depth != right->depth) return (left->depth > right->depth) ? -1 : 1;
+    return (left->quad > right->quad) ? -1 : 1;
+}
+
+//back to front, submission order within a layer
+static int compareTranslucentQuads(const void *a, const void *b) {
+    const struct QuadSortKey *left = a;
+    const struct QuadSortKey *right = b;
+    
+    if (left->depth != right->depth) return (left->depth < right->depth) ? -1 : 1;
+    return (left->quad < right->quad) ? -1 : 1;
+}
+
+static void copySortedQuads(struct Renderer *renderer, struct QuadSortKey *keys, u32 count, u32 firstQuad) {
+    for (u32 i = 0; i < count; i++) {
+        memcpy(&renderer->drawBuffer[(firstQuad + i) * VERTICES_PER_QUAD], &renderer->buffer[keys[i].quad * VERTICES_PER_QUAD],
+               sizeof(struct Vertex) * VERTICES_PER_QUAD);
+    }
+}
+
+static vec3 g_flushReasonColours[FLUSH_REASON_COUNT] = {
+    [FLUSH_EXPLICIT] = { 0.2f, 0.9f, 0.3f },
+    [FLUSH_BUFFER_FULL] = { 1.0f, 0.15f, 0.1f },
+    [FLUSH_TEXTURE_SLOTS] = { 1.0f, 0.6f, 0.0f },
+    [FLUSH_STATE_CHANGE] = { 0.2f, 0.4f, 1.0f },
+};
+
+#define DEBUG_BATCH_COLOUR_COUNT 8
+
+static vec3 g_batchColours[DEBUG_BATCH_COLOUR_COUNT] = {
+    { 0.9f, 0.2f, 0.2f }, { 0.2f, 0.9f, 0.2f }, { 0.2f, 0.3f, 0.9f }, { 0.9f, 0.9f, 0.2f },
+    { 0.9f, 0.2f, 0.9f }, { 0.2f, 0.9f, 0.9f }, { 0.9f, 0.5f, 0.1f }, { 0.6f, 0.3f, 0.9f },
+};
+
+//the debug variant replaces every shader while a debug view is on
+static u32 getBatchProgram(struct Renderer *renderer) {
+    return (renderer->debugMode != RENDERER_DEBUG_NONE) ? renderer->debugShader.id : renderer->currentShader.id;
+}
+
+//points a debug variant at this batch
+static void applyDebugMode(struct Renderer *renderer, u32 program, enum FlushReason reason) {
+    if (renderer->debugMode == RENDERER_DEBUG_OVERDRAW) {
+        glProgramUniform1i(program, DEBUG_MODE_LOCATION, DEBUG_OVERDRAW);
+    } else {
+        float *colour = (renderer->debugMode == RENDERER_DEBUG_BATCHES) ?
+            g_batchColours[renderer->batchIndex % DEBUG_BATCH_COLOUR_COUNT] : g_flushReasonColours[reason];
+        
+        glProgramUniform1i(program, DEBUG_MODE_LOCATION, DEBUG_TINT);
+        glProgramUniform4f(program, DEBUG_COLOUR_LOCATION, colour[0], colour[1], colour[2], 1.0f);
+    }
+}
+
+void setRendererDebugMode(struct Renderer *renderer, enum RendererDebugMode mode, struct Shader debugShader) {
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    submitQueuedDraws(renderer);
+    
+    renderer->debugMode = debugShader.id ? mode : RENDERER_DEBUG_NONE;
+    renderer->debugShader = debugShader;
+    
+    if (renderer->partialRedraw) damageEverything(renderer);
+}
+
+static bool isRectEmpty(int *rect) {
+    return rect[0] >= rect[2] || rect[1] >= rect[3];
+}
+
+static void addDamage(struct Renderer *renderer, int *bounds) {
+    int *damage = renderer->damage;
+    if (isRectEmpty(bounds)) return;
+    
+    if (isRectEmpty(damage)) {
+        memcpy(damage, bounds, sizeof(renderer->damage));
+        return;
+    }
+    
+    damage[0] = glm_min(damage[0], bounds[0]);
+    damage[1] = glm_min(damage[1], bounds[1]);
+    damage[2] = glm_max(damage[2], bounds[2]);
+    damage[3] = glm_max(damage[3], bounds[3]);
+}
+
+static u32 hashBytes(u32 hash, void *data, size_t size) {
+    u8 *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//where a recorded quad lands in the window and a hash of everything that decides what it draws there
+static struct QuadDamage getQuadDamage(struct Renderer *renderer, struct Vertex *vertices) {
+    float *camera = renderer->cameras[(int)vertices[0].camera][0];
+    vec2 minimum = { FLT_MAX, FLT_MAX };
+    vec2 maximum = { -FLT_MAX, -FLT_MAX };
+    
+    for (int i = 0; i < VERTICES_PER_QUAD; i++) {
+        vec4 clip;
+        glm_mat4_mulv((vec4 *)camera, vertices[i].position, clip);
+        float w = (clip[3] != 0.0f) ? clip[3] : 1.0f;
+        
+        vec2 window = {
+            (clip[0] / w * 0.5f + 0.5f) * renderer->frameWidth,
+            (clip[1] / w * 0.5f + 0.5f) * renderer->frameHeight
+        };
+        glm_vec2_minv(minimum, window, minimum);
+        glm_vec2_maxv(maximum, window, maximum);
+    }
+    
+    struct QuadDamage quad = {
+        .bounds = {
+            (int)glm_clamp(floorf(minimum[0]), 0.0f, (float)renderer->frameWidth),
+            (int)glm_clamp(floorf(minimum[1]), 0.0f, (float)renderer->frameHeight),
+            (int)glm_clamp(ceilf(maximum[0]), 0.0f, (float)renderer->frameWidth),
+            (int)glm_clamp(ceilf(maximum[1]), 0.0f, (float)renderer->frameHeight),
+        }
+    };
+    
+    //the slot index can change between frames, the texture behind it is what matters
+    int slot = (int)vertices[0].textureIndex;
+    u32 texture = (slot >= 0 && slot < RENDERER_TEXTURE_SLOTS) ? renderer->textureSlots[slot].id : 0;
+    
+    quad.hash = hashBytes(2166136261u, vertices, sizeof(struct Vertex) * VERTICES_PER_QUAD);
+    quad.hash = hashBytes(quad.hash, &texture, sizeof(texture));
+    quad.hash = hashBytes(quad.hash, quad.bounds, sizeof(quad.bounds));
+    
+    return quad;
+}
+
+//compares the batch against the same quads of the last frame, anything that changed is damaged where it
+//was and where it is now
+static void trackBatchDamage(struct Renderer *renderer) {
+    for (u32 i = 0; i < renderer->currentQuadCount; i++) {
+        u32 index = renderer->frameQuadCount++;
+        if (index >= renderer->maxFrameQuads) {
+            damageEverything(renderer);
+            continue;
+        }
+        
+        struct QuadDamage quad = getQuadDamage(renderer, &renderer->buffer[i * VERTICES_PER_QUAD]);
+        renderer->frameQuads[index] = quad;
+        
+        if (index >= renderer->previousFrameQuadCount) {
+            addDamage(renderer, quad.bounds);
+        } else if (renderer->previousFrameQuads[index].hash != quad.hash) {
+            addDamage(renderer, renderer->previousFrameQuads[index].bounds);
+            addDamage(renderer, quad.bounds);
+        }
+    }
+}
+
+//called right before drawing into the cached frame, anything drawn before present goes out before the rest of
+//the frame is known
+static void finishFrameDamage(struct Renderer *renderer) {
+    if (!renderer->presenting) {
+        damageEverything(renderer);
+        return;
+    }
+    
+    //quads that are gone this frame
+    for (u32 i = renderer->frameQuadCount; i < renderer->previousFrameQuadCount; i++) {
+        addDamage(renderer, renderer->previousFrameQuads[i].bounds);
+    }
+}
+
+//points drawing at the cached frame and clips it to the damage, false when nothing needs drawing
+static bool beginDamagedDraw(struct Renderer *renderer) {
+    int *damage = renderer->damage;
+    if (isRectEmpty(damage)) return false;
+    
+    bindDrawFramebuffer(renderer->frameCache.framebuffer);
+    setScissorEnabled(true);
+    setScissorRect(damage[0], damage[1], damage[2] - damage[0], damage[3] - damage[1]);
+    
+    if (renderer->clearPending) {
+        setClearColour(renderer->frameClearColour);
+        setDepthWrite(true);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderer->clearPending = false;
+    }
+    
+    //queued draws clip to the scissor themselves
+    if (renderer->scissorEnabled && !isQueueingBatches(renderer)) {
+        int *scissor = renderer->scissor;
+        int left = glm_max(damage[0], scissor[0]);
+        int bottom = glm_max(damage[1], scissor[1]);
+        int right = glm_min(damage[2], scissor[0] + scissor[2]);
+        int top = glm_min(damage[3], scissor[1] + scissor[3]);
+        
+        setScissorRect(left, bottom, glm_max(right - left, 0), glm_max(top - bottom, 0));
+    }
+    
+    return true;
+}
+
+void createRendererFrameCache(struct Renderer *renderer, struct Arena *arena, int width, int height, int maxFrameQuads) {
+    renderer->frameQuads = arenaAlloc(arena, sizeof(struct QuadDamage) * maxFrameQuads);
+    renderer->previousFrameQuads = arenaAlloc(arena, sizeof(struct QuadDamage) * maxFrameQuads);
+    renderer->maxFrameQuads = maxFrameQuads;
+    renderer->frameWidth = width;
+    renderer->frameHeight = height;
+    
+    renderer->frameCache = createRenderTarget(width, height, DEFAULT_TEXTURE_SETTINGS);
+}
+
+void setRendererPartialRedraw(struct Renderer *renderer, bool enabled) {
+    if (enabled == renderer->partialRedraw || renderer->frameCache.framebuffer == 0) return;
+    
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    submitQueuedDraws(renderer);
+    renderer->partialRedraw = enabled;
+    
+    if (enabled) {
+        //nothing in the cache is trusted yet
+        renderer->frameQuadCount = 0;
+        renderer->previousFrameQuadCount = 0;
+        damageEverything(renderer);
+    } else {
+        bindDrawFramebuffer(0);
+        applyRendererScissor(renderer);
+    }
+}
+
+void addRendererDamage(struct Renderer *renderer, int x, int y, int width, int height) {
+    if (!renderer->partialRedraw) return;
+    
+    int bounds[4] = {
+        glm_max(x, 0),
+        glm_max(y, 0),
+        glm_min(x + width, renderer->frameWidth),
+        glm_min(y + height, renderer->frameHeight)
+    };
+    addDamage(renderer, bounds);
+}
+
+bool presentRenderer(struct Renderer *renderer) {
+    if (!renderer->partialRedraw) {
+        flushRenderer(renderer);
+        return true;
+    }
+    
+    //a frame with nothing left to draw still clears what went away
+    renderer->presenting = true;
+    flushBatch(renderer, FLUSH_EXPLICIT);
+    if (renderer->queuedOpaqueCount + renderer->queuedTranslucentCount > 0) {
+        submitQueuedDraws(renderer);
+    } else {
+        finishFrameDamage(renderer);
+        beginDamagedDraw(renderer);
+    }
+    renderer->presenting = false;
+    
+    //NOTE: glfw has no way to present part of a frame and wgl has no buffer age, the back buffer is undefined
+    //after a swap so the whole cached frame is copied, but only on frames where something changed
+    bool damaged = !isRectEmpty(renderer->damage);
+    if (damaged) {
+        setScissorEnabled(false);
+        glBlitNamedFramebuffer(renderer->frameCache.framebuffer, 0, 0, 0, renderer->frameWidth, renderer->frameHeight,
+                               0, 0, renderer->frameWidth, renderer->frameHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    
+    struct QuadDamage *frameQuads = renderer->frameQuads;
+    renderer->frameQuads = renderer->previousFrameQuads;
+    renderer->previousFrameQuads = frameQuads;
+    renderer->previousFrameQuadCount = glm_min(renderer->frameQuadCount, renderer->maxFrameQuads);
+    renderer->frameQuadCount = 0;
+    
+    memset(renderer->damage, 0, sizeof(renderer->damage));
+    renderer->clearPending = false;
+    
+    return damaged;
+}
+
+static void bindBatchState(struct Renderer *renderer, u32 vertexArray, u32 program) {
+    bindVertexArray(vertexArray);
+    if (program) useProgram(program);
+    
+    for (int i = 0; i < renderer->currentTextureIndex; i++) {
+        bindTextureUnit(i, renderer->textureSlots[i].id);
+    }
+    bindTextureUnit(RENDERER_PALETTE_SLOT, renderer->paletteTexture);
+    
+    setDepthTestEnabled(true);
+}
+
+//the overdraw heatmap adds up every fragment that got past the depth test, opaque ones included
+static void beginOpaquePass(struct Renderer *renderer) {
+    applyBlendGroup((renderer->debugMode == RENDERER_DEBUG_OVERDRAW) ? 1 : 0);
+    setDepthFunction(GL_LESS);
+    setDepthWrite(true);
+}
+
+static void beginTranslucentPass(struct Renderer *renderer, int blendGroup) {
+    applyBlendGroup((renderer->debugMode == RENDERER_DEBUG_OVERDRAW) ? 1 : blendGroup);
+    setDepthFunction(GL_LEQUAL);
+    setDepthWrite(false);
+}
+
+//draws everything queued, opaque quads of all the queued batches first and then the translucent ones in order
+static void submitQueuedDraws(struct Renderer *renderer) {
+    u32 opaqueCount = renderer->queuedOpaqueCount;
+    u32 translucentCount = renderer->queuedTranslucentCount;
+    if (opaqueCount + translucentCount == 0) return;
+    
+    if (renderer->partialRedraw && !renderer->currentTarget) {
+        finishFrameDamage(renderer);
+        
+        //nothing the queued batches touch changed, the cached frame already has them
+        if (!beginDamagedDraw(renderer)) {
+            renderer->queuedQuadCount = 0;
+            renderer->queuedOpaqueCount = 0;
+            renderer->queuedTranslucentCount = 0;
+            return;
+        }
+    }
+    
+    PROFILE_BEGIN("submitQueuedDraws");
+    
+    //the base instance is how the clip rect attribute finds the draw's rect
+    for (u32 i = 0; i < opaqueCount; i++) {
+        renderer->opaqueDraws[i].baseInstance = i;
+    }
+    for (u32 i = 0; i < translucentCount; i++) {
+        renderer->translucentDraws[i].baseInstance = opaqueCount + i;
+    }
+    
+    glNamedBufferSubData(renderer->indirectBuffer, 0, sizeof(struct DrawCommand) * opaqueCount, renderer->opaqueDraws);
+    glNamedBufferSubData(renderer->indirectBuffer, sizeof(struct DrawCommand) * opaqueCount,
+                         sizeof(struct DrawCommand) * translucentCount, renderer->translucentDraws);
+    glNamedBufferSubData(renderer->clipRectBuffer, 0, sizeof(vec4) * opaqueCount, renderer->opaqueClipRects);
+    glNamedBufferSubData(renderer->clipRectBuffer, sizeof(vec4) * opaqueCount, sizeof(vec4) * translucentCount,
+                         renderer->translucentClipRects);
+    
+    if (renderer->debugMode != RENDERER_DEBUG_NONE) {
+        applyDebugMode(renderer, renderer->debugShader.id, renderer->queuedReason);
+    }
+    bindBatchState(renderer, renderer->multiDrawVao, renderer->queuedProgram);
+    setClipDistancesEnabled(true);
+    
+    //user scissors are per draw here, gl's only ever holds the partial redraw damage
+    if (!renderer->partialRedraw || renderer->currentTarget) {
+        setScissorEnabled(false);
+    }
+    
+    if (opaqueCount) {
+        beginOpaquePass(renderer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, opaqueCount, 0);
+        renderer->stats.drawCalls++;
+    }
+    
+    if (translucentCount) {
+        beginTranslucentPass(renderer, renderer->queuedBlendGroup);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)(sizeof(struct DrawCommand) * opaqueCount),
+                                    translucentCount, 0);
+        renderer->stats.drawCalls++;
+    }
+    
+    //orphaned so the next batches never wait on these draws to be done reading it
+    glInvalidateBufferData(renderer->multiDrawVbo);
+    
+    renderer->queuedQuadCount = 0;
+    renderer->queuedOpaqueCount = 0;
+    renderer->queuedTranslucentCount = 0;
+    renderer->batchIndex++;
+    
+    PROFILE_END();
+}
+
+//appends the sorted batch in drawBuffer to the queue, submitting first when it cannot share a draw with what is there
+static void queueBatch(struct Renderer *renderer, enum FlushReason reason, u32 opaqueCount, u32 translucentCount) {
+    u32 quadCount = opaqueCount + translucentCount;
+    u32 program = getBatchProgram(renderer);
+    
+    bool queued = (renderer->queuedOpaqueCount + renderer->queuedTranslucentCount) > 0;
+    bool full = renderer->queuedQuadCount + quadCount > renderer->maxQueuedQuads ||
+        renderer->queuedOpaqueCount == renderer->maxQueuedDraws || renderer->queuedTranslucentCount == renderer->maxQueuedDraws;
+    bool differs = program != renderer->queuedProgram ||
+        (translucentCount && renderer->queuedTranslucentCount && renderer->translucentBlendGroup != renderer->queuedBlendGroup);
+    
+    if (queued && (full || differs)) {
+        submitQueuedDraws(renderer);
+    }
+    
+    u32 firstQuad = renderer->queuedQuadCount;
+    glNamedBufferSubData(renderer->multiDrawVbo, sizeof(struct Vertex) * VERTICES_PER_QUAD * firstQuad,
+                         sizeof(struct Vertex) * VERTICES_PER_QUAD * quadCount, renderer->drawBuffer);
+    renderer->queuedQuadCount += quadCount;
+    
+    vec4 clipRect;
+    getClipRect(renderer, clipRect);
+    
+    //the index buffer repeats the same quad pattern, the base vertex moves it onto each batch
+    if (opaqueCount) {
+        u32 draw = renderer->queuedOpaqueCount++;
+        renderer->opaqueDraws[draw] = (struct DrawCommand) { INDICIES_PER_QUAD * opaqueCount, 1, 0, firstQuad * VERTICES_PER_QUAD, 0 };
+        glm_vec4_copy(clipRect, renderer->opaqueClipRects[draw]);
+    }
+    
+    if (translucentCount) {
+        u32 draw = renderer->queuedTranslucentCount++;
+        renderer->translucentDraws[draw] = (struct DrawCommand) {
+            INDICIES_PER_QUAD * translucentCount, 1, 0, (firstQuad + opaqueCount) * VERTICES_PER_QUAD, 0
+        };
+        glm_vec4_copy(clipRect, renderer->translucentClipRects[draw]);
+        renderer->queuedBlendGroup = renderer->translucentBlendGroup;
+    }
+    
+    renderer->queuedProgram = program;
+    renderer->queuedReason = reason;
+}
+
+void createRendererMultiDraw(struct Renderer *renderer, struct Arena *arena, int maxQuads, int maxDraws) {
+    //batches are never larger than the index buffer, which the draws share
+    assert((u32)maxQuads >= renderer->maxQuadsPerBatch);
+    
+    renderer->maxQueuedQuads = maxQuads;
+    renderer->maxQueuedDraws = maxDraws;
+    renderer->opaqueDraws = arenaAlloc(arena, sizeof(struct DrawCommand) * maxDraws);
+    renderer->translucentDraws = arenaAlloc(arena, sizeof(struct DrawCommand) * maxDraws);
+    renderer->opaqueClipRects = arenaAlloc(arena, sizeof(vec4) * maxDraws);
+    renderer->translucentClipRects = arenaAlloc(arena, sizeof(vec4) * maxDraws);
+    
+    glCreateVertexArrays(1, &renderer->multiDrawVao);
+    bindVertexArray(renderer->multiDrawVao);
+    
+    glCreateBuffers(1, &renderer->multiDrawVbo);
+    glNamedBufferData(renderer->multiDrawVbo, sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuads, NULL, GL_DYNAMIC_DRAW);
+    TRACK_GPU_ALLOCATION("gl buffer", sizeof(struct Vertex) * VERTICES_PER_QUAD * maxQuads);
+    bindArrayBuffer(renderer->multiDrawVbo);
+    setQuadVertexAttributes(renderer->multiDrawVao);
+    
+    //one rect per draw, instanced attributes are fetched at the base instance so each draw reads its own
+    glCreateBuffers(1, &renderer->clipRectBuffer);
+    glNamedBufferData(renderer->clipRectBuffer, sizeof(vec4) * maxDraws * 2, NULL, GL_DYNAMIC_DRAW);
+    TRACK_GPU_ALLOCATION("gl buffer", sizeof(vec4) * maxDraws * 2);
+    bindArrayBuffer(renderer->clipRectBuffer);
+    glEnableVertexArrayAttrib(renderer->multiDrawVao, CLIP_ATTRIBUTE);
+    glVertexAttribPointer(CLIP_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(vec4), NULL);
+    glVertexAttribDivisor(CLIP_ATTRIBUTE, 1);
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
+    
+    //NOTE: the indirect binding is context state and nothing else uses it, so it is bound once here
+    glCreateBuffers(1, &renderer->indirectBuffer);
+    glNamedBufferData(renderer->indirectBuffer, sizeof(struct DrawCommand) * maxDraws * 2, NULL, GL_DYNAMIC_DRAW);
+    TRACK_GPU_ALLOCATION("gl buffer", sizeof(struct DrawCommand) * maxDraws * 2);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirectBuffer);
+}
+
+void setRendererMultiDraw(struct Renderer *renderer, bool enabled) {
+    if (enabled == renderer->multiDraw || renderer->multiDrawVao == 0) return;
+    
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    submitQueuedDraws(renderer);
+    renderer->multiDraw = enabled;
+    
+    if (!enabled) {
+        applyRendererScissor(renderer);
+    }
+}
+
+void flushRenderer(struct Renderer *renderer) {
+    flushBatch(renderer, FLUSH_EXPLICIT);
+    submitQueuedDraws(renderer);
+}
+
+static void flushBatch(struct Renderer *renderer, enum FlushReason reason) {
+    if (renderer->currentQuadCount == 0) return;
+    
+    PROFILE_BEGIN("flushRenderer");
+    
+    bool queueing = isQueueingBatches(renderer);
+    if (renderer->partialRedraw && !renderer->currentTarget) {
+        trackBatchDamage(renderer);
+        
+        //queued batches are clipped to the damage when the queue is submitted, the rest go out now
+        if (!queueing) {
+            finishFrameDamage(renderer);
+            
+            //nothing this batch touches changed, the cached frame already has it
+            if (!beginDamagedDraw(renderer)) {
+                advanceDepthSequence(renderer);
+                renderer->currentQuadCount = 0;
+                renderer->opaqueQuadCount = 0;
+                renderer->translucentQuadCount = 0;
+                PROFILE_END();
+                return;
+            }
+        }
+    }
+    
+    u32 opaqueCount = renderer->opaqueQuadCount;
+    u32 translucentCount = renderer->translucentQuadCount;
+    
+    qsort(renderer->opaqueQuads, opaqueCount, sizeof(struct QuadSortKey), compareOpaqueQuads);
+    qsort(renderer->translucentQuads, translucentCount, sizeof(struct QuadSortKey), compareTranslucentQuads);
+    
+    copySortedQuads(renderer, renderer->opaqueQuads, opaqueCount, 0);
+    copySortedQuads(renderer, renderer->translucentQuads, translucentCount, opaqueCount);
+    
+    if (queueing) {
+        queueBatch(renderer, reason, opaqueCount, translucentCount);
+    } else {
+        int bufferSize = sizeof(struct Vertex) * VERTICES_PER_QUAD * renderer->currentQuadCount;
+        
+        if (renderer->debugMode != RENDERER_DEBUG_NONE) {
+            applyDebugMode(renderer, renderer->debugShader.id, reason);
+        }
+        bindBatchState(renderer, renderer->vao, getBatchProgram(renderer));
+        setClipDistancesEnabled(false);
+        
+        bindArrayBuffer(renderer->vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bufferSize, renderer->drawBuffer);
+        
+        //opaque first so everything behind it fails the depth test before it is shaded
+        if (opaqueCount) {
+            beginOpaquePass(renderer);
+            glDrawElements(GL_TRIANGLES, INDICIES_PER_QUAD * opaqueCount, GL_UNSIGNED_INT, NULL);
+            renderer->stats.drawCalls++;
+        }
+        
+        if (translucentCount) {
+            beginTranslucentPass(renderer, renderer->translucentBlendGroup);
+            glDrawElements(GL_TRIANGLES, INDICIES_PER_QUAD * translucentCount, GL_UNSIGNED_INT,
+                           (const void *)(sizeof(u32) * INDICIES_PER_QUAD * opaqueCount));
+            renderer->stats.drawCalls++;
+        }
+    }
+    
+    renderer->stats.quads += renderer->currentQuadCount;
+    renderer->stats.opaqueQuads += opaqueCount;
+    renderer->stats.flushes[reason]++;
+    renderer->batchIndex++;
+    advanceDepthSequence(renderer);
+    renderer->currentQuadCount = 0;
+    renderer->opaqueQuadCount = 0;
+    renderer->translucentQuadCount = 0;
+    
+    PROFILE_END();
+}
+
+void setRendererScissor(struct Renderer *renderer, int x, int y, int width, int height) {
+    int *scissor = renderer->scissor;
+    if (renderer->scissorEnabled && scissor[0] == x && scissor[1] == y && scissor[2] == width && scissor[3] == height) {
+        return;
+    }
+    
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    renderer->scissorEnabled = true;
+    scissor[0] = x;
+    scissor[1] = y;
+    scissor[2] = width;
+    scissor[3] = height;
+    
+    applyRendererScissor(renderer);
+}
+
+void clearRendererScissor(struct Renderer *renderer) {
+    if (!renderer->scissorEnabled) return;
+    
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    renderer->scissorEnabled = false;
+    
+    applyRendererScissor(renderer);
+}
+
+struct RendererStats resetRendererStats(struct Renderer *renderer) {
+    struct RendererStats stats = renderer->stats;
+    stats.glCalls = g_glState.calls;
+    stats.glCallsElided = g_glState.elidedCalls;
+    
+    renderer->stats = (struct RendererStats) { 0 };
+    renderer->batchIndex = 0;
+    g_glState.calls = 0;
+    g_glState.elidedCalls = 0;
+    
+    return stats;
+}
+
+struct Image loadImage(char *path) {
+    struct Image image = { 0 };
     
     image.pixels = stbi_load(path, &image.width, &image.height, &image.bytesPerPixel, 0);
     image.pitch = image.width * image.bytesPerPixel;
+    image.arena = image.pixels ? t_imageArena : NULL;
+    
+    return image;
+}
+
+#define IMAGE_DECODE_MAX_THREADS 16
+
+struct ImageDecodeJob {
+    struct FileBatch *batch;
+    struct Image *images;
+    
+    struct Arena *arena;
+    struct Semaphore *arenaLock;
+};
+
+static void decodeImagesProc(void *data) {
+    struct ImageDecodeJob *job = data;
+    
+    //stb's temporaries never outlive a single image, so they get reset after every decode
+    struct Arena scratch = { 0 };
+    struct Arena *previousArena = t_imageArena;
+    t_imageArena = job->arena ? &scratch : NULL;
+    
+    Buffer file;
+    int index;
+    
+    while ((index = waitForNextFile(job->batch, &file)) != -1) {
+        struct Image image = { 0 };
+        PROFILE_BEGIN("decodeImage");
+        
+        if (file.data) {
+            image.pixels = stbi_load_from_memory(file.data, (int)file.size, &image.width, &image.height, &image.bytesPerPixel, 0);
+            image.pitch = image.width * image.bytesPerPixel;
+        }
+        
+        if (job->arena && image.pixels) {
+            size_t size = (size_t)image.pitch * image.height;
+            
+            waitSemaphore(job->arenaLock);
+            u8 *pixels = arenaAlloc(job->arena, size);
+            signalSemaphore(job->arenaLock);
+            
+            memcpy(pixels, image.pixels, size);
+            image.pixels = pixels;
+            image.arena = job->arena;
+            
+            resetArena(&scratch);
+        }
+        
+        job->images[index] = image;
+        PROFILE_END();
+    }
     
-    return image;
+    t_imageArena = previousArena;
+    freeArena(&scratch);
+}
+
+void loadImages(char **paths, struct Image *images, int count, struct Arena *arena) {
+    PROFILE_BEGIN("loadImages");
+    
+    //the encoded files are only needed until they are decoded
+    struct Arena fileArena = { 0 };
+    
+    struct ImageDecodeJob job = { 0 };
+    job.batch = beginFileBatch(paths, count, &fileArena);
+    job.images = images;
+    job.arena = arena;
+    job.arenaLock = createSemaphore(1);
+    
+    int threadCount = getProcessorCount() - 1;
+    if (threadCount > count - 1) threadCount = count - 1;
+    if (threadCount > IMAGE_DECODE_MAX_THREADS) threadCount = IMAGE_DECODE_MAX_THREADS;
+    
+    struct Thread *threads[IMAGE_DECODE_MAX_THREADS];
+    int startedCount = 0;
+    
+    for (int i = 0; i < threadCount; i++) {
+        threads[startedCount] = createThread(decodeImagesProc, &job);
+        if (threads[startedCount]) startedCount++;
+    }
+    
+    //the calling thread decodes too
+    decodeImagesProc(&job);
+    
+    for (int i = 0; i < startedCount; i++) {
+        joinThread(threads[i]);
+    }
+    
+    freeFileBatch(job.batch);
+    freeSemaphore(job.arenaLock);
+    freeArena(&fileArena);
+    
+    PROFILE_END();
 }
 
 void freeImage(struct Image *image) {
-    free(image->pixels);
+    if (!image->arena) {
+        free(image->pixels);
+    }
     image->pixels = NULL;
+    image->arena = NULL;
     
     image->width = 0;
     image->height = 0;
@@ -365,38 +2056,726 @@ void freeImage(struct Image *image) {
     image->pitch = 0;
 }
 
+int createPalette(struct Renderer *renderer, u32 *colours, int colourCount) {
+    int palette;
+    if (renderer->freePaletteCount) {
+        palette = renderer->freePalettes[--renderer->freePaletteCount];
+    } else if (renderer->paletteCount < RENDERER_MAX_PALETTES) {
+        palette = renderer->paletteCount++;
+    } else {
+        printf("ERROR out of palette rows!\n");
+        return -1;
+    }
+    
+    setPaletteColours(renderer, palette, colours, colourCount);
+    
+    return palette;
+}
+
+void freePalette(struct Renderer *renderer, int palette) {
+    assert(palette >= 0 && palette < renderer->paletteCount);
+    assert(renderer->freePaletteCount < renderer->paletteCount);
+    
+    renderer->freePalettes[renderer->freePaletteCount++] = palette;
+}
+
+void setPaletteColours(struct Renderer *renderer, int palette, u32 *colours, int colourCount) {
+    assert(palette >= 0 && palette < renderer->paletteCount);
+    assert(colourCount <= PALETTE_SIZE);
+    
+    submitQueuedDraws(renderer);
+    glTextureSubImage2D(renderer->paletteTexture, 0, 0, palette, colourCount, 1, GL_RGBA, GL_UNSIGNED_BYTE, colours);
+}
+
+#define PALETTE_HASH_SIZE (PALETTE_SIZE * 2)
+
+struct Image loadIndexedImage(char *path, u32 *palette, int *colourCount) {
+    struct Image indexed = { 0 };
+    *colourCount = 0;
+    
+    int width, height, channels;
+    u32 *pixels = (u32 *)stbi_load(path, &width, &height, &channels, 4);
+    if (!pixels) {
+        return indexed;
+    }
+    
+    u8 *indices = imageAlloc(width * height);
+    
+    //open addressing from colour to palette index, 0 marks an empty slot so indices are stored + 1
+    u32 keys[PALETTE_HASH_SIZE];
+    u16 values[PALETTE_HASH_SIZE] = { 0 };
+    
+    for (int i = 0; i < width * height; i++) {
+        u32 colour = pixels[i];
+        u32 slot = (colour * 2654435761u) % PALETTE_HASH_SIZE;
+        
+        while (values[slot] && keys[slot] != colour) {
+            slot = (slot + 1) % PALETTE_HASH_SIZE;
+        }
+        
+        if (!values[slot]) {
+            if (*colourCount == PALETTE_SIZE) {
+                printf("ERROR %s has more than %d colours!\n", path, PALETTE_SIZE);
+                
+                imageFree(indices);
+                stbi_image_free(pixels);
+                *colourCount = 0;
+                
+                return indexed;
+            }
+            
+            palette[*colourCount] = colour;
+            keys[slot] = colour;
+            values[slot] = (u16)++(*colourCount);
+        }
+        
+        indices[i] = (u8)(values[slot] - 1);
+    }
+    
+    stbi_image_free(pixels);
+    
+    indexed.pixels = indices;
+    indexed.width = width;
+    indexed.height = height;
+    indexed.bytesPerPixel = 1;
+    indexed.pitch = width;
+    indexed.arena = t_imageArena;
+    
+    return indexed;
+}
+
+#define TEXTURE_MAX_MIP_LEVELS 16
+
+static int getMipLevelCount(int width, int height) {
+    int size = (width > height) ? width : height;
+    int levels = 1;
+    
+    while (size > 1 && levels < TEXTURE_MAX_MIP_LEVELS) {
+        size >>= 1;
+        levels++;
+    }
+    
+    return levels;
+}
+
+//only the allocation tracker asks
+#ifdef SALAMANDER_DEBUG
+static size_t getTextureStorageSize(int width, int height, int mipLevels, int bytesPerTexel) {
+    size_t size = 0;
+    
+    for (int i = 0; i < mipLevels; i++) {
+        size += (size_t)width * height * bytesPerTexel;
+        
+        width = (width > 1) ? width / 2 : 1;
+        height = (height > 1) ? height / 2 : 1;
+    }
+    
+    return size;
+}
+#endif
+
+static int getFilterMode(enum TextureFilter filter) {
+    return (filter == TEXTURE_FILTER_NEAREST) ? GL_NEAREST : GL_LINEAR;
+}
+
+static int getMinFilterMode(struct TextureSettings settings, int mipLevels) {
+    if (mipLevels <= 1) {
+        return getFilterMode(settings.minFilter);
+    }
+    
+    if (settings.minFilter == TEXTURE_FILTER_NEAREST) {
+        return (settings.mipFilter == TEXTURE_FILTER_NEAREST) ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST_MIPMAP_LINEAR;
+    }
+    
+    return (settings.mipFilter == TEXTURE_FILTER_NEAREST) ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR;
+}
+
+static int getPixelFormat(int bytesPerPixel) {
+    switch (bytesPerPixel) {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 3: return GL_RGB;
+        default: return GL_RGBA;
+    }
+}
+
+static void applyTextureSettings(struct Texture texture, struct TextureSettings settings) {
+    glTextureParameteri(texture.id, GL_TEXTURE_MIN_FILTER, getMinFilterMode(settings, texture.mipLevels));
+    glTextureParameteri(texture.id, GL_TEXTURE_MAG_FILTER, getFilterMode(settings.magFilter));
+    glTextureParameteri(texture.id, GL_TEXTURE_MAX_LEVEL, texture.mipLevels - 1);
+    
+    int wrap = (settings.wrap == TEXTURE_WRAP_CLAMP) ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTextureParameteri(texture.id, GL_TEXTURE_WRAP_S, wrap);
+    glTextureParameteri(texture.id, GL_TEXTURE_WRAP_T, wrap);
+}
+
 //TODO move this
-static struct Texture createTextureFromImage(struct Image image) {
+struct Texture createTextureFromImages(struct Image *levels, int levelCount, struct TextureSettings settings) {
     struct Texture texture = { 0 };
     
-    texture.width = image.width;
-    texture.height = image.height;
+    texture.width = levels[0].width;
+    texture.height = levels[0].height;
+    texture.mipLevels = levelCount;
+    
+    bool generateMipmaps = (levelCount == 1 && settings.generateMipmaps);
+    if (generateMipmaps) {
+        texture.mipLevels = getMipLevelCount(texture.width, texture.height);
+    }
+    
+    texture.format = (levels[0].bytesPerPixel == 1) ? TEXTURE_FORMAT_R8 : TEXTURE_FORMAT_RGBA8;
     
     glCreateTextures(GL_TEXTURE_2D, 1, &texture.id);
-    glTextureStorage2D(texture.id, 1, GL_RGBA8, texture.width, texture.height);
+    glTextureStorage2D(texture.id, texture.mipLevels, (texture.format == TEXTURE_FORMAT_R8) ? GL_R8 : GL_RGBA8, texture.width, texture.height);
+    TRACK_GPU_ALLOCATION("gl texture", getTextureStorageSize(texture.width, texture.height, texture.mipLevels, (texture.format == TEXTURE_FORMAT_R8) ? 1 : 4));
+    
+    if (texture.format == TEXTURE_FORMAT_R8) {
+        //single channel images are greyscale, indexed textures only ever read .r
+        int swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTextureParameteriv(texture.id, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
     
-    glTextureParameteri(texture.id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTextureParameteri(texture.id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    applyTextureSettings(texture, settings);
     
-    glTextureParameteri(texture.id, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTextureParameteri(texture.id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    for (int i = 0; i < levelCount; i++) {
+        struct Image image = levels[i];
+        
+        glPixelStorei(GL_UNPACK_ALIGNMENT, (image.pitch % 4 == 0) ? 4 : 1);
+        glTextureSubImage2D(texture.id, i, 0, 0, image.width, image.height, getPixelFormat(image.bytesPerPixel), GL_UNSIGNED_BYTE, image.pixels);
+    }
     
-    glTextureSubImage2D(texture.id, 0, 0, 0, texture.width, texture.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+    if (generateMipmaps) {
+        glGenerateTextureMipmap(texture.id);
+    }
     
     return texture;
 }
 
+//<name>.mip<level><extension> next to the base image
+static void getMipLevelPath(char *path, int level, char *levelPath, int levelPathSize) {
+    char *extension = strrchr(path, '.');
+    char *separator = strrchr(path, '/');
+    char *backslash = strrchr(path, '\\');
+    if (backslash > separator) separator = backslash;
+    
+    if (!extension || extension < separator) {
+        extension = path + strlen(path);
+    }
+    
+    snprintf(levelPath, levelPathSize, "%.*s.mip%d%s", (int)(extension - path), path, level, extension);
+}
+
+static bool isMipLevelSized(struct Image *base, struct Image *image, int level, char *levelPath) {
+    int expectedWidth = (base->width >> level) ? (base->width >> level) : 1;
+    int expectedHeight = (base->height >> level) ? (base->height >> level) : 1;
+    
+    if (image->width != expectedWidth || image->height != expectedHeight) {
+        printf("WARNING mip level %s is %dx%d, expected %dx%d\n", levelPath, image->width, image->height, expectedWidth, expectedHeight);
+        return false;
+    }
+    
+    return true;
+}
+
+//NOTE: stops at the first missing or wrongly sized level, whatever was found before that is used as is
+static int loadPrecomputedMipLevels(char *path, struct Image *levels) {
+    char levelPath[260];
+    
+    int levelCount = 1;
+    int fullChain = getMipLevelCount(levels[0].width, levels[0].height);
+    
+    for (int i = 1; i < fullChain; i++) {
+        getMipLevelPath(path, i, levelPath, sizeof(levelPath));
+        
+        struct Image image = loadImage(levelPath);
+        if (!image.pixels) break;
+        
+        if (!isMipLevelSized(&levels[0], &image, i, levelPath)) {
+            freeImage(&image);
+            break;
+        }
+        
+        levels[levelCount++] = image;
+    }
+    
+    return levelCount;
+}
+
 struct Texture loadTexture(char *path) {
-    struct Image image = loadImage(path);
-    struct Texture texture = createTextureFromImage(image);
+    return loadTextureEx(path, DEFAULT_TEXTURE_SETTINGS);
+}
+
+struct Texture loadTextureEx(char *path, struct TextureSettings settings) {
+    struct Image levels[TEXTURE_MAX_MIP_LEVELS] = { 0 };
+    int levelCount = 1;
+    
+    levels[0] = loadImage(path);
+    if (settings.generateMipmaps && levels[0].pixels) {
+        levelCount = loadPrecomputedMipLevels(path, levels);
+    }
+    
+    struct Texture texture = createTextureFromImages(levels, levelCount, settings);
+    
+    for (int i = 0; i < levelCount; i++) {
+        freeImage(&levels[i]);
+    }
+    
+    return texture;
+}
+
+struct Texture loadIndexedTexture(struct Renderer *renderer, char *path) {
+    u32 colours[PALETTE_SIZE];
+    int colourCount;
+    
+    struct Image image = loadIndexedImage(path, colours, &colourCount);
+    if (!image.pixels) {
+        return (struct Texture) { 0 };
+    }
+    
+    //without a row the indices would be drawn as grey
+    int palette = createPalette(renderer, colours, colourCount);
+    if (palette < 0) {
+        printf("ERROR no palette row left for %s!\n", path);
+        freeImage(&image);
+        return (struct Texture) { 0 };
+    }
+    
+    //NOTE: filtering or averaging palette indices makes no sense, so these are always nearest without mips
+    struct TextureSettings settings = { TEXTURE_FILTER_NEAREST, TEXTURE_FILTER_NEAREST, TEXTURE_FILTER_NEAREST, TEXTURE_WRAP_REPEAT, false };
+    struct Texture texture = createTextureFromImages(&image, 1, settings);
+    
+    texture.format = TEXTURE_FORMAT_INDEXED8;
+    texture.palette = palette;
     
     freeImage(&image);
     
     return texture;
 }
 
+#define TEXTURE_PATH_SIZE 260
+
+void loadTextures(char **paths, struct Texture *textures, int count, struct TextureSettings settings) {
+    //pixels are gone as soon as they are uploaded
+    struct Arena imageArena = { 0 };
+    
+    struct Image *images = arenaAlloc(&imageArena, count * sizeof(struct Image));
+    loadImages(paths, images, count, &imageArena);
+    
+    //the base images give the length of each chain, then every precomputed level is read in a second batch
+    int *firstLevels = arenaAlloc(&imageArena, count * sizeof(int));
+    int *chainLengths = arenaAlloc(&imageArena, count * sizeof(int));
+    int levelFileCount = 0;
+    
+    for (int i = 0; i < count; i++) {
+        firstLevels[i] = levelFileCount;
+        chainLengths[i] = (settings.generateMipmaps && images[i].pixels) ? getMipLevelCount(images[i].width, images[i].height) - 1 : 0;
+        levelFileCount += chainLengths[i];
+    }
+    
+    char **levelPaths = arenaAlloc(&imageArena, levelFileCount * sizeof(char *));
+    struct Image *levelImages = arenaAlloc(&imageArena, levelFileCount * sizeof(struct Image));
+    
+    for (int i = 0; i < count; i++) {
+        for (int level = 1; level <= chainLengths[i]; level++) {
+            char *levelPath = arenaAlloc(&imageArena, TEXTURE_PATH_SIZE);
+            getMipLevelPath(paths[i], level, levelPath, TEXTURE_PATH_SIZE);
+            levelPaths[firstLevels[i] + level - 1] = levelPath;
+        }
+    }
+    
+    if (levelFileCount) {
+        loadImages(levelPaths, levelImages, levelFileCount, &imageArena);
+    }
+    
+    PROFILE_BEGIN("uploadTextures");
+    for (int i = 0; i < count; i++) {
+        struct Image levels[TEXTURE_MAX_MIP_LEVELS];
+        levels[0] = images[i];
+        int levelCount = 1;
+        
+        //same rule as loadTextureEx, the chain ends at the first missing or wrongly sized level
+        for (int level = 1; level <= chainLengths[i]; level++) {
+            int index = firstLevels[i] + level - 1;
+            struct Image *image = &levelImages[index];
+            
+            if (!image->pixels || !isMipLevelSized(&images[i], image, level, levelPaths[index])) break;
+            levels[levelCount++] = *image;
+        }
+        
+        textures[i] = createTextureFromImages(levels, levelCount, settings);
+    }
+    PROFILE_END();
+    
+    freeArena(&imageArena);
+}
+
 void freeTexture(struct Texture *texture) {
+    if (texture->format == TEXTURE_FORMAT_INDEXED8) {
+        freePalette(&g_renderer, texture->palette);
+    }
+    
     glDeleteTextures(1, &texture->id);
+    forgetDeletedTexture(texture->id);
     texture->width = 0;
     texture->height = 0;
+    texture->mipLevels = 0;
+    texture->format = TEXTURE_FORMAT_RGBA8;
+    texture->palette = 0;
+}
+
+struct RenderTarget createRenderTarget(int width, int height, struct TextureSettings settings) {
+    struct RenderTarget target = { 0 };
+    struct Texture *texture = &target.texture;
+    
+    texture->width = width;
+    texture->height = height;
+    texture->mipLevels = settings.generateMipmaps ? getMipLevelCount(width, height) : 1;
+    texture->format = TEXTURE_FORMAT_RGBA8;
+    texture->flipY = true;
+    
+    target.usedWidth = width;
+    target.usedHeight = height;
+    
+    glCreateTextures(GL_TEXTURE_2D, 1, (u32 *)&texture->id);
+    glTextureStorage2D(texture->id, texture->mipLevels, GL_RGBA8, width, height);
+    TRACK_GPU_ALLOCATION("gl texture", getTextureStorageSize(width, height, texture->mipLevels, 4));
+    applyTextureSettings(*texture, settings);
+    
+    //the batcher sorts opaque quads against depth, so targets need their own
+    glCreateRenderbuffers(1, &target.depth);
+    glNamedRenderbufferStorage(target.depth, GL_DEPTH_COMPONENT24, width, height);
+    TRACK_GPU_ALLOCATION("gl renderbuffer", width * height * 4);
+    
+    glCreateFramebuffers(1, &target.framebuffer);
+    glNamedFramebufferTexture(target.framebuffer, GL_COLOR_ATTACHMENT0, texture->id, 0);
+    glNamedFramebufferRenderbuffer(target.framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depth);
+    
+    if (glCheckNamedFramebufferStatus(target.framebuffer, GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("ERROR render target framebuffer (%dx%d) is incomplete!\n", width, height);
+    }
+    
+    return target;
+}
+
+void beginRenderTarget(struct Renderer *renderer, struct RenderTarget *target, float *clearColour) {
+    assert(!renderer->currentTarget);
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    submitQueuedDraws(renderer);
+    renderer->currentTarget = target;
+    
+    bindDrawFramebuffer(target->framebuffer);
+    setScissorEnabled(false);
+    glViewport(0, 0, target->usedWidth, target->usedHeight);
+    
+    if (clearColour) {
+        //the heatmap only reads right on black, here too since the target is shown through it
+        vec4 black = { 0.0f, 0.0f, 0.0f, 1.0f };
+        setClearColour((renderer->debugMode == RENDERER_DEBUG_OVERDRAW) ? black : clearColour);
+        setDepthWrite(true);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    
+    //the clear covers the whole target, the scissor only what is drawn into it
+    applyRendererScissor(renderer);
+}
+
+void endRenderTarget(struct Renderer *renderer) {
+    struct RenderTarget *target = renderer->currentTarget;
+    assert(target);
+    
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    submitQueuedDraws(renderer);
+    renderer->currentTarget = NULL;
+    
+    if (target->texture.mipLevels > 1) {
+        glGenerateTextureMipmap(target->texture.id);
+    }
+    
+    int *viewport = renderer->viewport;
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    
+    //partial redraw cannot tell which quads show the target, so the cached frame is redrawn
+    if (renderer->partialRedraw) {
+        damageEverything(renderer);
+    } else {
+        bindDrawFramebuffer(0);
+        applyRendererScissor(renderer);
+    }
+}
+
+void freeRenderTarget(struct RenderTarget *target) {
+    if (g_glState.drawFramebuffer == target->framebuffer) g_glState.drawFramebuffer = GL_STATE_UNKNOWN;
+    
+    glDeleteFramebuffers(1, &target->framebuffer);
+    glDeleteRenderbuffers(1, &target->depth);
+    freeTexture(&target->texture);
+    
+    target->framebuffer = 0;
+    target->depth = 0;
+}
+
+void drawUpscaledTarget(struct Renderer *renderer, struct RenderTarget *target, enum UpscaleFilter filter, struct Shader sharpBilinearShader) {
+    struct Texture texture = target->texture;
+    float width = (float)renderer->viewport[2];
+    float height = (float)renderer->viewport[3];
+    
+    float scale = glm_min(width / texture.width, height / texture.height);
+    if (filter == UPSCALE_NEAREST) {
+        scale = glm_max(floorf(scale), 1.0f);
+    }
+    
+    vec2 position = {
+        floorf((width - texture.width * scale) * 0.5f),
+        floorf((height - texture.height * scale) * 0.5f)
+    };
+    
+    //the filter is part of the texture, nothing sampling it is pending since endRenderTarget flushed
+    glTextureParameteri(texture.id, GL_TEXTURE_MAG_FILTER, (filter == UPSCALE_NEAREST) ? GL_NEAREST : GL_LINEAR);
+    
+    struct Shader shader = renderer->currentShader;
+    enum BlendMode blendMode = renderer->currentBlendMode;
+    
+    if (filter == UPSCALE_SHARP_BILINEAR) {
+        //a scaled down target has cleared texels past its used part, the shader keeps its samples off them. an
+        //earlier upscale still waiting to be drawn needs the old size
+        flushBatch(renderer, FLUSH_STATE_CHANGE);
+        submitQueuedDraws(renderer);
+        glProgramUniform2f(sharpBilinearShader.id, SHARP_BILINEAR_USED_SIZE_LOCATION, (float)target->usedWidth, (float)target->usedHeight);
+        setRendererShader(renderer, sharpBilinearShader);
+    }
+    setRendererBlendMode(renderer, BLEND_OPAQUE);
+    
+    //the debug views already went into the target, the quad has to show them instead of its own output
+    enum RendererDebugMode debugMode = renderer->debugMode;
+    if (debugMode != RENDERER_DEBUG_NONE) {
+        flushBatch(renderer, FLUSH_STATE_CHANGE);
+        renderer->debugMode = RENDERER_DEBUG_NONE;
+    }
+    
+    //a scaled down target still covers the area of the whole one
+    vec4 sourceRect = { 0.0f, 0.0f, (float)target->usedWidth / texture.width, (float)target->usedHeight / texture.height };
+    drawTextureEx(renderer, texture, position, (vec2){ scale / sourceRect[2], scale / sourceRect[3] }, (vec2){ 0.0f, 0.0f }, 0.0f,
+                  sourceRect, SPRITE_FLIP_NONE);
+    
+    if (debugMode != RENDERER_DEBUG_NONE) {
+        flushBatch(renderer, FLUSH_STATE_CHANGE);
+        renderer->debugMode = debugMode;
+    }
+    
+    setRendererShader(renderer, shader);
+    setRendererBlendMode(renderer, blendMode);
+}
+
+void setRenderTargetScale(struct RenderTarget *target, float scale) {
+    scale = glm_clamp(scale, 0.0f, 1.0f);
+    target->usedWidth = glm_max((int)(target->texture.width * scale + 0.5f), 1);
+    target->usedHeight = glm_max((int)(target->texture.height * scale + 0.5f), 1);
+}
+
+struct GPUTimer createGPUTimer(void) {
+    struct GPUTimer timer = { 0 };
+    glCreateQueries(GL_TIME_ELAPSED, GPU_TIMER_QUERIES, timer.queries);
+    return timer;
+}
+
+void beginGPUTimer(struct GPUTimer *timer, float scale) {
+    //every query is still in flight, this frame goes unmeasured rather than waiting on the oldest
+    if (timer->begun - timer->read == GPU_TIMER_QUERIES) return;
+    
+    timer->scales[timer->begun % GPU_TIMER_QUERIES] = scale;
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[timer->begun % GPU_TIMER_QUERIES]);
+    timer->running = true;
+}
+
+void endGPUTimer(struct GPUTimer *timer) {
+    if (!timer->running) return;
+    
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->running = false;
+    timer->begun++;
+}
+
+bool readGPUTimer(struct GPUTimer *timer, double *seconds, float *scale) {
+    bool found = false;
+    
+    //queries finish in order, take everything that is back and keep the newest
+    while (timer->read != timer->begun) {
+        u32 query = timer->queries[timer->read % GPU_TIMER_QUERIES];
+        
+        int available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        
+        u64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        *seconds = (double)nanoseconds / 1000000000.0;
+        *scale = timer->scales[timer->read % GPU_TIMER_QUERIES];
+        
+        timer->read++;
+        found = true;
+    }
+    
+    return found;
+}
+
+//NOTE: rising is kept slow and the scale moves in 1/32 steps, otherwise it hunts around the budget every frame
+#define RESOLUTION_SCALE_STEP (1.0f / 32.0f)
+#define RESOLUTION_RISE_RATE 0.1f
+#define RESOLUTION_HEADROOM 0.9
+
+struct ResolutionController createResolutionController(double budget, float minScale, float maxScale) {
+    struct ResolutionController controller = { budget, minScale, maxScale, maxScale };
+    return controller;
+}
+
+float updateResolutionController(struct ResolutionController *controller, double gpuTime, float gpuScale) {
+    if (gpuTime <= 0.0 || gpuScale <= 0.0f) return controller->scale;
+    
+    //pixels follow the square of the scale, aim a little under the budget so noise does not push it over. the time
+    //is scaled from the resolution it was measured at, the controller may have moved since that query was issued
+    float fit = gpuScale * (float)sqrt(controller->budget * RESOLUTION_HEADROOM / gpuTime);
+    fit = glm_clamp(fit, controller->minScale, controller->maxScale);
+    
+    float scale = controller->scale;
+    if (fit < scale) {
+        scale = floorf(fit / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+    } else if (fit - scale >= RESOLUTION_SCALE_STEP) {
+        scale += glm_max((fit - scale) * RESOLUTION_RISE_RATE, RESOLUTION_SCALE_STEP);
+        scale = floorf(scale / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+    }
+    
+    controller->scale = glm_clamp(scale, controller->minScale, controller->maxScale);
+    return controller->scale;
+}
+
+struct SpriteBuffer createSpriteBuffer(struct Arena *arena, struct Texture texture, int capacity) {
+    struct SpriteBuffer buffer = { 0 };
+    buffer.texture = texture;
+    buffer.capacity = capacity;
+    buffer.sprites = arenaAlloc(arena, sizeof(struct GPUSprite) * capacity);
+    
+    glCreateBuffers(1, &buffer.buffer);
+    glNamedBufferStorage(buffer.buffer, sizeof(struct GPUSprite) * capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+    TRACK_GPU_ALLOCATION("gl buffer", sizeof(struct GPUSprite) * capacity);
+    
+    return buffer;
+}
+
+void freeSpriteBuffer(struct SpriteBuffer *buffer) {
+    glDeleteBuffers(1, &buffer->buffer);
+    buffer->buffer = 0;
+    buffer->count = 0;
+}
+
+static void markSpriteDirty(struct SpriteBuffer *buffer, int index) {
+    if (buffer->dirtyStart == buffer->dirtyEnd) {
+        buffer->dirtyStart = index;
+        buffer->dirtyEnd = index + 1;
+    } else {
+        buffer->dirtyStart = glm_min(buffer->dirtyStart, index);
+        buffer->dirtyEnd = glm_max(buffer->dirtyEnd, index + 1);
+    }
+    
+    buffer->count = glm_max(buffer->count, index + 1);
+}
+
+void setSprite(struct Renderer *renderer, struct SpriteBuffer *buffer, int index, struct Sprite *sprite) {
+    assert(index >= 0 && index < buffer->capacity);
+    struct Texture texture = buffer->texture;
+    struct GPUSprite *record = &buffer->sprites[index];
+    
+    record->position[0] = sprite->position[0];
+    record->position[1] = sprite->position[1];
+    record->size[0] = texture.width * (sprite->sourceRect[2] - sprite->sourceRect[0]) * sprite->scale[0];
+    record->size[1] = texture.height * (sprite->sourceRect[3] - sprite->sourceRect[1]) * sprite->scale[1];
+    glm_vec2_copy(sprite->origin, record->origin);
+    record->rotation = sprite->rotation;
+    record->layer = renderer->currentDepth;
+    
+    getSourceUVs(sprite->sourceRect, sprite->flip ^ getTextureFlip(texture), record->uv);
+    record->colour = COLOUR_WHITE;
+    record->camera = (u32)renderer->currentCamera;
+    record->blendMode = (u32)renderer->currentBlendMode;
+    record->palette = getTexturePalette(texture);
+    
+    markSpriteDirty(buffer, index);
+}
+
+void setSpriteColour(struct SpriteBuffer *buffer, int index, vec4 colour) {
+    assert(index >= 0 && index < buffer->count);
+    buffer->sprites[index].colour = packColour(colour);
+    markSpriteDirty(buffer, index);
+}
+
+void drawSpriteBuffer(struct Renderer *renderer, struct SpriteBuffer *buffer, struct Shader vertexPullingShader,
+                      struct Shader vertexPullingDebugShader) {
+    if (buffer->count == 0) return;
+    
+    //without its debug variant the buffer would show up as plain colour in the middle of a debug view
+    bool debug = renderer->debugMode != RENDERER_DEBUG_NONE;
+    if (debug && !vertexPullingDebugShader.id) return;
+    
+    //whatever was drawn before the buffer has to land first
+    flushBatch(renderer, FLUSH_STATE_CHANGE);
+    submitQueuedDraws(renderer);
+    
+    PROFILE_BEGIN("drawSpriteBuffer");
+    
+    if (buffer->dirtyEnd > buffer->dirtyStart) {
+        glNamedBufferSubData(buffer->buffer, sizeof(struct GPUSprite) * buffer->dirtyStart,
+                             sizeof(struct GPUSprite) * (buffer->dirtyEnd - buffer->dirtyStart), &buffer->sprites[buffer->dirtyStart]);
+        buffer->dirtyStart = 0;
+        buffer->dirtyEnd = 0;
+    }
+    
+    //NOTE: the records are not compared with last frame, so partial redraw has to redraw all of it
+    if (renderer->partialRedraw && !renderer->currentTarget) {
+        damageEverything(renderer);
+        beginDamagedDraw(renderer);
+    }
+    
+    //the draw counts as a batch of its own for the debug views, ended explicitly
+    u32 program = vertexPullingShader.id;
+    if (debug) {
+        program = vertexPullingDebugShader.id;
+        applyDebugMode(renderer, program, FLUSH_EXPLICIT);
+    }
+    
+    //the slot is taken back by the next batch, its bindings go through the same cache
+    bindVertexArray(renderer->spriteVao);
+    useProgram(program);
+    glProgramUniform1f(program, SPRITE_DEPTH_OFFSET_LOCATION, getSequenceDepth(renderer));
+    bindTextureUnit(0, buffer->texture.id);
+    bindTextureUnit(RENDERER_PALETTE_SLOT, renderer->paletteTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RENDERER_SPRITE_BINDING, buffer->buffer);
+    setDepthTestEnabled(true);
+    
+    int blendGroup = getBlendGroup(renderer->currentBlendMode);
+    if (blendGroup == 0) {
+        beginOpaquePass(renderer);
+    } else {
+        beginTranslucentPass(renderer, blendGroup);
+    }
+    
+    //the scissor goes through the clip rect, gl's may only hold the partial redraw damage
+    vec4 clipRect;
+    getClipRect(renderer, clipRect);
+    bool clipped = renderer->scissorEnabled;
+    setClipDistancesEnabled(clipped);
+    if (clipped) {
+        glVertexAttrib4fv(CLIP_ATTRIBUTE, clipRect);
+    }
+    
+    glDrawArrays(GL_TRIANGLES, 0, buffer->count * INDICIES_PER_QUAD);
+    
+    if (clipped) {
+        glVertexAttrib4fv(CLIP_ATTRIBUTE, NO_CLIP_RECT);
+    }
+    
+    renderer->stats.drawCalls++;
+    renderer->stats.quads += buffer->count;
+    renderer->stats.flushes[FLUSH_EXPLICIT]++;
+    renderer->batchIndex++;
+    advanceDepthSequence(renderer);
+    
+    PROFILE_END();
 }
\ No newline at end of file
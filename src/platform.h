@@ -2,10 +2,43 @@
 #define SALAMANDER_PLATFORM_H
 
 #include "basic.h"
+#include "arena.h"
 
 #define INPUT_KEY_BUFFER_SIZE 128
 #define INPUT_BUTTON_BUFFER_SIZE 3
 
+//power of two, events past this many undrained ones are dropped
+#define INPUT_QUEUE_SIZE 1024
+
+enum InputEventType {
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_BUTTON_DOWN,
+    INPUT_BUTTON_UP,
+    INPUT_MOUSE_MOVE,
+};
+
+struct InputEvent {
+    u64 timestamp;
+    
+    u8 type;
+    bool repeat;
+    u16 code;
+    
+    float mouseX;
+    float mouseY;
+};
+
+//single producer (the window callbacks) single consumer (processInput), indices only ever grow
+struct InputQueue {
+    struct InputEvent events[INPUT_QUEUE_SIZE];
+    
+    volatile i32 writeIndex;
+    volatile i32 readIndex;
+    
+    u32 droppedCount;
+};
+
 struct Platform {
     void *nativeWindow;
     
@@ -14,13 +47,36 @@ struct Platform {
     
     bool windowClosed;
     
-    //Input state
+    //Input state, derived from the events drained by processInput
     u8 keyState[INPUT_KEY_BUFFER_SIZE];
     u8 buttonState[INPUT_BUTTON_BUFFER_SIZE];
     
     float mouseX;
     float mouseY;
     
+    struct InputQueue inputQueue;
+    
+    //every event the last processInput drained, for anything that needs more than the derived state
+    struct InputEvent inputEvents[INPUT_QUEUE_SIZE];
+    int inputEventCount;
+    
+    //only these have pressed/released bits that need clearing on the next processInput
+    u8 changedKeys[INPUT_KEY_BUFFER_SIZE];
+    int changedKeyCount;
+    u8 changedButtons[INPUT_BUTTON_BUFFER_SIZE];
+    int changedButtonCount;
+    
+    //whether each key is down counting events the simulation has not drained yet, filled by latchInput
+    bool latchedKeyDown[INPUT_KEY_BUFFER_SIZE];
+    
+    //input to photon, the oldest key or button event that has not been on screen yet and, once the swap
+    //after it returns, how long ago it happened in seconds. scanout adds up to another refresh on top
+    u64 oldestUnpresentedInput;
+    double inputLatency;
+    
+    //set when nothing on screen changed (see presentRenderer), updatePlatform leaves the last frame up
+    bool skipSwap;
+    
     //Polling functions
     bool (*isKeyDown)(int);
     bool (*isKeyPressed)(int);
@@ -34,12 +90,117 @@ struct Platform {
 struct Platform *createPlatform(char *title, int width, int height);
 void updatePlatform(struct Platform *platform);
 
+//drains queued events that happened at or before the timestamp and updates the derived input state
+void processInput(struct Platform *platform, u64 until);
+
+//late latch, polls the os again right before submission and fills latchedKeyDown without draining the queue
+void latchInput(struct Platform *platform);
+
+//0 presents immediately, 1 waits for vblank, -1 tears late frames instead of waiting a whole extra vblank
+void setSwapInterval(struct Platform *platform, int interval);
+
 typedef struct {
-    int size;
+    size_t size;
     u8 *data;
+    
+    //mapped buffers are read-only views of the file and are not null terminated
+    bool mapped;
 } Buffer;
 
+// file io
 Buffer readFileIntoBuffer(char *path);
-int findLineInBuffer(Buffer buffer, char *line);
+Buffer mapFileIntoBuffer(char *path);
+void freeBuffer(Buffer *buffer);
+
+// time
+u64 getTimestamp(void);
+u64 getTimestampFrequency(void);
+double getSecondsBetween(u64 start, u64 end);
+
+//NOTE: the os can oversleep by a good fraction of a millisecond, endFrame sleeps short and spins the rest
+void sleepFor(double seconds);
+
+// frame loop, the simulation runs in fixed steps and rendering interpolates between the last two of them
+#define FRAME_STATS_WINDOW 120
+#define FRAME_MAX_STEPS 8
+
+struct FrameStats {
+    //seconds, over the last FRAME_STATS_WINDOW frames
+    double frameTime;
+    double averageFrameTime;
+    double minFrameTime;
+    double maxFrameTime;
+    
+    u64 frameCount;
+};
+
+struct FrameLoop {
+    double fixedStep;
+    double targetFrameTime;
+    
+    //how far between the previous and the current step the frame being rendered is, in [0, 1)
+    float alpha;
+    
+    double accumulator;
+    int stepsThisFrame;
+    
+    //the moment the current step simulates up to, input that happened later waits for the next step
+    u64 stepTimestamp;
+    u64 timestampFrequency;
+    
+    u64 frameStart;
+    
+    //how early the limiter stops sleeping and starts spinning, tracks how much the os oversleeps
+    double spinMargin;
+    
+    float samples[FRAME_STATS_WINDOW];
+    struct FrameStats stats;
+};
+
+//a frame rate of 0 leaves pacing to the swap interval
+void createFrameLoop(struct FrameLoop *loop, double fixedStep, double targetFrameRate);
+//measures the frame that just ended into the stats and adds it to the simulation time
+void beginFrame(struct FrameLoop *loop);
+
+//returns true while there is another fixed step to simulate this frame
+bool stepFrame(struct FrameLoop *loop);
+
+//sleeps off whatever is left of the target frame time
+void endFrame(struct FrameLoop *loop);
+
+// threads
+struct Thread;
+struct Semaphore;
+typedef void (*ThreadProc)(void *data);
+
+struct Thread *createThread(ThreadProc proc, void *data);
+void joinThread(struct Thread *thread);
+int getProcessorCount(void);
+
+struct Semaphore *createSemaphore(int initialCount);
+void signalSemaphore(struct Semaphore *semaphore);
+void waitSemaphore(struct Semaphore *semaphore);
+void freeSemaphore(struct Semaphore *semaphore);
+
+//returns the value before the add
+i32 atomicAdd(volatile i32 *value, i32 addend);
+
+//acquire and release, enough to hand data between two threads
+i32 atomicLoad(volatile i32 *value);
+void atomicStore(volatile i32 *value, i32 newValue);
+
+//sets value to desired only if it still holds expected, true when it did
+bool atomicCompareExchange(volatile i32 *value, i32 expected, i32 desired);
+
+// batched reads, every file is read concurrently (io_uring on linux, a pool of reader threads otherwise)
+// and handed out in completion order, buffers are allocated from the given arena
+struct FileBatch;
+
+struct FileBatch *beginFileBatch(char **paths, int count, struct Arena *arena);
+
+//NOTE: safe to call from several threads, returns the index of a finished file (its buffer is empty if the
+//read failed) or -1 once every file has been handed out
+int waitForNextFile(struct FileBatch *batch, Buffer *file);
+void freeFileBatch(struct FileBatch *batch);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "profiler.h"
+#include "platform.h"
+
+#include <stdarg.h>
+
+#ifdef SALAMANDER_PROFILE
+
+struct ProfileEvent {
+    const char *name;
+    u64 start;
+    u64 end;
+};
+
+struct ProfileThread {
+    int id;
+    const char *name;
+    
+    struct ProfileEvent events[PROFILE_RING_SIZE];
+    volatile i32 writeCount;
+    
+    struct ProfileEvent *open[PROFILE_MAX_DEPTH];
+    int depth;
+    
+    //set once the owning thread has exited and the slot can be taken over
+    volatile i32 released;
+};
+
+struct Profiler {
+    struct ProfileThread *threads[PROFILE_MAX_THREADS];
+    volatile i32 threadCount;
+    
+    u64 startTimestamp;
+};
+
+static struct Profiler g_profiler;
+static THREAD_LOCAL struct ProfileThread *t_profileThread;
+
+//NOTE: the first zone on a thread registers it. a thread that exits leaves its slot and ring to the next one,
+//so short lived workers keep reusing a few slots and their events stay in the trace under the same tid.
+//a slot is only allocated when none is free, threads past PROFILE_MAX_THREADS live ones are not recorded
+static struct ProfileThread *getProfileThread(void) {
+    if (!t_profileThread) {
+        i32 threadCount = atomicLoad(&g_profiler.threadCount);
+        for (int i = 0; i < threadCount; i++) {
+            struct ProfileThread *thread = g_profiler.threads[i];
+            if (thread && atomicCompareExchange(&thread->released, 1, 0)) {
+                thread->name = NULL;
+                thread->depth = 0;
+                
+                t_profileThread = thread;
+                return thread;
+            }
+        }
+        
+        i32 id = threadCount;
+        while (id < PROFILE_MAX_THREADS && !atomicCompareExchange(&g_profiler.threadCount, id, id + 1)) {
+            id = atomicLoad(&g_profiler.threadCount);
+        }
+        
+        if (id >= PROFILE_MAX_THREADS) {
+            return NULL;
+        }
+        
+        struct ProfileThread *thread = calloc(1, sizeof(struct ProfileThread));
+        thread->id = id;
+        
+        if (id == 0) {
+            g_profiler.startTimestamp = getTimestamp();
+        }
+        
+        g_profiler.threads[id] = thread;
+        t_profileThread = thread;
+    }
+    
+    return t_profileThread;
+}
+
+void profileBegin(const char *name) {
+    struct ProfileThread *thread = getProfileThread();
+    if (!thread) return;
+    
+    //deeper nesting than this is still timed, it just is not recorded
+    if (thread->depth < PROFILE_MAX_DEPTH) {
+        struct ProfileEvent *event = &thread->events[thread->writeCount % PROFILE_RING_SIZE];
+        event->name = name;
+        event->start = getTimestamp();
+        event->end = 0;
+        
+        thread->open[thread->depth] = event;
+        atomicAdd(&thread->writeCount, 1);
+    }
+    
+    thread->depth++;
+}
+
+void profileEnd(void) {
+    struct ProfileThread *thread = t_profileThread;
+    if (!thread || thread->depth == 0) return;
+    
+    thread->depth--;
+    if (thread->depth < PROFILE_MAX_DEPTH) {
+        thread->open[thread->depth]->end = getTimestamp();
+    }
+}
+
+void setProfileThreadName(const char *name) {
+    struct ProfileThread *thread = getProfileThread();
+    if (thread) {
+        thread->name = name;
+    }
+}
+
+void releaseProfileThread(void) {
+    struct ProfileThread *thread = t_profileThread;
+    if (!thread) return;
+    
+    t_profileThread = NULL;
+    atomicStore(&thread->released, 1);
+}
+
+//NOTE: the trace is streamed out a chunk at a time, it gets written from inside the main loop where the
+//allocation guard is on and the rings can hold far more than would be sensible to build up in memory
+#define PROFILE_TRACE_CHUNK_SIZE (64 * 1024)
+
+struct TraceWriter {
+    FILE *file;
+    char chunk[PROFILE_TRACE_CHUNK_SIZE];
+    size_t length;
+    bool failed;
+};
+
+static struct TraceWriter g_traceWriter;
+
+static void flushTraceWriter(struct TraceWriter *writer) {
+    if (writer->length && fwrite(writer->chunk, 1, writer->length, writer->file) != writer->length) {
+        writer->failed = true;
+    }
+    writer->length = 0;
+}
+
+//false when the record did not fit even in an empty chunk, it is left out
+static bool writeTraceRecord(struct TraceWriter *writer, const char *format, ...) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t space = PROFILE_TRACE_CHUNK_SIZE - writer->length;
+        
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(writer->chunk + writer->length, space, format, args);
+        va_end(args);
+        
+        if (written < 0) return false;
+        if ((size_t)written < space) {
+            writer->length += written;
+            return true;
+        }
+        
+        flushTraceWriter(writer);
+    }
+    
+    return false;
+}
+
+bool writeProfileTrace(char *path) {
+    double ticksToMicroseconds = 1000000.0 / (double)getTimestampFrequency();
+    
+    struct TraceWriter *writer = &g_traceWriter;
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        printf("ERROR opening %s for the profile trace!\n", path);
+        return false;
+    }
+    
+    writer->length = 0;
+    writer->failed = false;
+    
+    writeTraceRecord(writer, "{\"traceEvents\":[\n");
+    
+    int threadCount = atomicLoad(&g_profiler.threadCount);
+    
+    bool first = true;
+    for (int i = 0; i < threadCount; i++) {
+        struct ProfileThread *thread = g_profiler.threads[i];
+        if (!thread) continue;
+        
+        int writeCount = atomicAdd(&thread->writeCount, 0);
+        int eventCount = (writeCount < PROFILE_RING_SIZE) ? writeCount : PROFILE_RING_SIZE;
+        
+        if (thread->name) {
+            if (writeTraceRecord(writer, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                                 first ? "" : ",\n", thread->id, thread->name)) {
+                first = false;
+            }
+        }
+        
+        for (int e = writeCount - eventCount; e < writeCount; e++) {
+            struct ProfileEvent event = thread->events[e % PROFILE_RING_SIZE];
+            if (!event.end || event.end < event.start) continue;
+            
+            double start = (double)(event.start - g_profiler.startTimestamp) * ticksToMicroseconds;
+            double duration = (double)(event.end - event.start) * ticksToMicroseconds;
+            
+            if (writeTraceRecord(writer, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                                 first ? "" : ",\n", event.name, thread->id, start, duration)) {
+                first = false;
+            }
+        }
+    }
+    
+    writeTraceRecord(writer, "\n]}\n");
+    flushTraceWriter(writer);
+    
+    bool written = !writer->failed;
+    if (fclose(writer->file) != 0) written = false;
+    writer->file = NULL;
+    
+    if (written) {
+        printf("wrote profile trace to %s\n", path);
+    } else {
+        printf("ERROR writing profile trace to %s!\n", path);
+    }
+    
+    return written;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef SALAMANDER_PROFILER_H
+#define SALAMANDER_PROFILER_H
+
+#include "basic.h"
+
+// cpu zones, every thread records into its own ring buffer and writeProfileTrace dumps all of them as a
+// chrome://tracing / perfetto json file. zone names are stored by pointer, so they have to be string literals
+#ifdef SALAMANDER_PROFILE
+
+#define PROFILE_MAX_THREADS 32
+#define PROFILE_RING_SIZE (64 * 1024)
+#define PROFILE_MAX_DEPTH 32
+
+void profileBegin(const char *name);
+void profileEnd(void);
+void setProfileThreadName(const char *name);
+
+//hands the calling thread's slot to the next thread that profiles, createThread calls it when the proc returns
+void releaseProfileThread(void);
+
+bool writeProfileTrace(char *path);
+
+#define PROFILE_BEGIN(name) profileBegin(name)
+#define PROFILE_END() profileEnd()
+
+#else
+
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+
+static inline void setProfileThreadName(const char *name) {}
+static inline void releaseProfileThread(void) {}
+static inline bool writeProfileTrace(char *path) { return false; }
+
+#endif
+
+#endif
\ No newline at end of file
@@ -2,35 +2,359 @@
 #define SALAMANDER_RENDERER_H
 
 #include "basic.h"
+#include "arena.h"
 
 struct Shader {
     u32 id;
 };
 #define NO_SHADER (struct Shader) { 0 }
 
+enum TextureFormat {
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_R8,
+    
+    //R8 indices into a row of the renderer's shared palette texture
+    TEXTURE_FORMAT_INDEXED8,
+};
+
 struct Texture {
     int id;
     int width;
     int height;
+    
+    int mipLevels;
+    
+    enum TextureFormat format;
+    int palette;
+    
+    //rendered by gl (see RenderTarget), rows are stored bottom up and the draw functions flip them back
+    bool flipY;
+};
+
+enum TextureFilter {
+    TEXTURE_FILTER_NEAREST,
+    TEXTURE_FILTER_LINEAR,
+};
+
+enum TextureWrap {
+    TEXTURE_WRAP_REPEAT,
+    TEXTURE_WRAP_CLAMP,
+};
+
+struct TextureSettings {
+    enum TextureFilter minFilter;
+    enum TextureFilter magFilter;
+    
+    //NOTE: only used when the texture has more than one mip level
+    enum TextureFilter mipFilter;
+    
+    enum TextureWrap wrap;
+    
+    //build the chain with glGenerateTextureMipmap when no precomputed levels are found
+    bool generateMipmaps;
 };
+#define DEFAULT_TEXTURE_SETTINGS (struct TextureSettings) { TEXTURE_FILTER_LINEAR, TEXTURE_FILTER_NEAREST, TEXTURE_FILTER_NEAREST, TEXTURE_WRAP_REPEAT, false }
+#define MIPMAPPED_TEXTURE_SETTINGS (struct TextureSettings) { TEXTURE_FILTER_LINEAR, TEXTURE_FILTER_NEAREST, TEXTURE_FILTER_LINEAR, TEXTURE_WRAP_REPEAT, true }
 
 // shader code
+struct ShaderTemplate;
+
 struct Shader loadShader(char *path);
+
+struct ShaderTemplate *loadShaderTemplate(char *path);
+struct Shader getShaderVariant(struct ShaderTemplate *shaderTemplate, char *defines);
+void freeShaderTemplate(struct ShaderTemplate *shaderTemplate);
+
+// batched loading, every program is submitted up front and the driver can compile them in parallel
+// when KHR_parallel_shader_compile is available, otherwise each shader is compiled as it is added
+struct ShaderBatch;
+struct ShaderBatch *beginShaderBatch(void);
+void addShaderToBatch(struct ShaderBatch *batch, char *path, struct Shader *shader);
+bool pollShaderBatch(struct ShaderBatch *batch);
+void finishShaderBatch(struct ShaderBatch *batch);
 void useShader(struct Shader shader);
 
 void setShaderMat4(struct Shader shader, char *uniform, mat4 matrix);
 
 // renderer
 struct Renderer;
-struct Renderer *createRenderer(int maxQuadsPerBatch);
+struct Renderer *createRenderer(struct Arena *arena, int maxQuadsPerBatch);
 
 void clearRenderer(vec4 colour);
 
+// materials, the shader and blend mode are batch state: setting them only flushes when the batch would
+// actually draw differently. alpha, premultiplied, additive and cutout quads are all blended as premultiplied
+// alpha (the shader converts per vertex) so they share batches, multiply needs its own. cutouts get all or
+// nothing coverage, which keeps discard out of the shaders so the opaque pass keeps early depth testing.
+// opaque quads never break a batch, each flush draws them first sorted front to back against the depth
+// buffer, then the translucent ones back to front without writing depth
+enum BlendMode {
+    BLEND_OPAQUE,
+    BLEND_CUTOUT,
+    BLEND_ALPHA,
+    BLEND_PREMULTIPLIED,
+    BLEND_ADDITIVE,
+    BLEND_MULTIPLY,
+};
+
+struct Material {
+    struct Shader shader;
+    enum BlendMode blendMode;
+};
+
+//quads drawn after these use the given state, NO_SHADER draws with whatever program useShader bound
+void setRendererShader(struct Renderer *renderer, struct Shader shader);
+void setRendererBlendMode(struct Renderer *renderer, enum BlendMode blendMode);
+void setRendererMaterial(struct Renderer *renderer, struct Material material);
+
+//quads drawn after this sit on the given layer, in [-1, 1] with higher layers in front. both ends are usable,
+//-1 is kept just off the far plane so it still draws over the cleared depth. within a layer later quads go
+//on top as usual, across flushes too as long as layers are not within a hair (1/1048576 per batch) of each other.
+//translucent quads also go on top of opaque ones drawn before them on the same layer. clearRenderer starts over
+void setRendererLayer(struct Renderer *renderer, float layer);
+
+// cameras, every view projection lives in one uniform buffer and each quad records which one it uses, so the
+// world, parallax layers and the hud share a batch. a matrix set any time before a flush applies to that
+// whole batch, so it can be latched late without re-recording geometry
+#define RENDERER_MAX_CAMERAS 8
+
+void setRendererCamera(struct Renderer *renderer, int camera, mat4 viewProjection);
+
+//quads drawn after this use the given camera
+void useRendererCamera(struct Renderer *renderer, int camera);
+
+// colours, packed rgba8 with red in the lowest byte, which is the byte order the vertex attribute reads
+#define PACK_COLOUR(r, g, b, a) ((u32)(r) | ((u32)(g) << 8) | ((u32)(b) << 16) | ((u32)(a) << 24))
+#define COLOUR_WHITE 0xFFFFFFFFu
+
+u32 packColour(vec4 colour);
+
 void drawQuad(struct Renderer *renderer, vec2 position, vec2 size, vec4 colour);
+void drawQuadPacked(struct Renderer *renderer, vec2 position, vec2 size, u32 colour);
+
+//corners go top left, top right, bottom right, bottom left
+void drawQuadGradient(struct Renderer *renderer, vec2 position, vec2 size, u32 colours[4]);
+void drawTextureTinted(struct Renderer *renderer, struct Texture texture, vec2 position, vec2 scale, u32 tint);
+
 void drawTexture(struct Renderer *renderer, struct Texture texture, vec2 position, vec2 scale);
+void drawIndexedTexture(struct Renderer *renderer, struct Texture texture, int palette, vec2 position, vec2 scale);
+
+// sprites, rotations are in radians around origin, the pivot as a fraction of the quad ({ 0.5f, 0.5f } is the
+// centre) which is also the point that lands on position. source rects are uvs (left, top, right, bottom)
+enum SpriteFlip {
+    SPRITE_FLIP_NONE = 0,
+    SPRITE_FLIP_X = 1,
+    SPRITE_FLIP_Y = 2,
+};
+
+#define FULL_SOURCE_RECT ((vec4){ 0.0f, 0.0f, 1.0f, 1.0f })
+
+struct Sprite {
+    vec2 position;
+    vec2 scale;
+    vec2 origin;
+    float rotation;
+    
+    vec4 sourceRect;
+    int flip;
+};
+
+void drawQuadEx(struct Renderer *renderer, vec2 position, vec2 size, vec2 origin, float rotation, vec4 colour);
+void drawTextureEx(struct Renderer *renderer, struct Texture texture, vec2 position, vec2 scale, vec2 origin, float rotation,
+                   vec4 sourceRect, int flip);
+
+//many sprites sharing a texture, the sines and cosines are computed in bulk
+void drawSprites(struct Renderer *renderer, struct Texture texture, struct Sprite *sprites, int count);
 
 void flushRenderer(struct Renderer *renderer);
 
+// render targets, everything drawn between beginRenderTarget and endRenderTarget goes into the target's texture,
+// which can then be drawn like any other until it needs redrawing. clearColour can be NULL to draw over what is
+// already there. targets do not nest and the quads in them use the same cameras, give them one covering the target
+struct RenderTarget {
+    struct Texture texture;
+    u32 framebuffer;
+    u32 depth;
+    
+    //the corner of the texture that is drawn into, see setRenderTargetScale
+    int usedWidth;
+    int usedHeight;
+};
+
+struct RenderTarget createRenderTarget(int width, int height, struct TextureSettings settings);
+void beginRenderTarget(struct Renderer *renderer, struct RenderTarget *target, float *clearColour);
+void endRenderTarget(struct Renderer *renderer);
+void freeRenderTarget(struct RenderTarget *target);
+
+//renders the target at a fraction of its size without reallocating it, cameras still cover all of it so the
+//picture just has fewer pixels. only drawUpscaledTarget knows to show the used part
+void setRenderTargetScale(struct RenderTarget *target, float scale);
+
+// gpu timers, each keeps a few queries in flight so reading one back never waits for the gpu. the time covers
+// the gl commands between begin and end, flush (or end a render target) before ending. timers cannot overlap
+#define GPU_TIMER_QUERIES 4
+
+struct GPUTimer {
+    u32 queries[GPU_TIMER_QUERIES];
+    
+    //the scale each query's work was rendered at, results arrive frames after the scale may have moved on
+    float scales[GPU_TIMER_QUERIES];
+    u32 begun;
+    u32 read;
+    bool running;
+};
+
+struct GPUTimer createGPUTimer(void);
+void beginGPUTimer(struct GPUTimer *timer, float scale);
+void endGPUTimer(struct GPUTimer *timer);
+
+//true when a measurement finished since the last read, seconds is the newest one that did and scale what it was
+//begun with
+bool readGPUTimer(struct GPUTimer *timer, double *seconds, float *scale);
+
+// dynamic resolution, picks the scale to render a pass at from its gpu time and the scale that time was measured
+// at. the cost of a pass is taken to follow its pixel count (the scale squared), the scale drops straight to what
+// fits the budget and climbs back slowly
+struct ResolutionController {
+    double budget;
+    float minScale;
+    float maxScale;
+    float scale;
+};
+
+struct ResolutionController createResolutionController(double budget, float minScale, float maxScale);
+float updateResolutionController(struct ResolutionController *controller, double gpuTime, float gpuScale);
+
+// low resolution rendering for pixel art, draw the world into a target at its logical resolution with a camera
+// covering it 1:1 (which also snaps every sprite to the art's pixel grid) and then upscale the used part of the
+// target with one quad using the current camera, which has to cover the window in pixels like a hud camera.
+// nearest scales by the largest whole factor that fits and centres the result. sharp bilinear fills as much of
+// the window as the aspect ratio allows and only blends the one screen pixel along each texel edge, so uneven
+// scales don't show it. it needs the SHARP_BILINEAR variant of default.glsl
+enum UpscaleFilter {
+    UPSCALE_NEAREST,
+    UPSCALE_SHARP_BILINEAR,
+};
+
+void drawUpscaledTarget(struct Renderer *renderer, struct RenderTarget *target, enum UpscaleFilter filter, struct Shader sharpBilinearShader);
+
+// partial redraw, for mostly static screens like tools and menus. the frame is kept in an offscreen framebuffer
+// between frames and every quad is compared with the same quad last frame, only the area under quads that
+// changed, appeared or went away is cleared and redrawn. with the multi draw buffers created the frame's batches
+// wait in its queue until presentRenderer, whether multi draw is on or not, so the damage is known before any of
+// them is drawn. whatever submits the queue earlier (see multi draw below) or, without those buffers, any batch
+// flushed before presentRenderer redraws everything. changes the renderer cannot see (a texture or palette being
+// rewritten) need addRendererDamage. the cache is created up front so switching the mode never allocates
+void createRendererFrameCache(struct Renderer *renderer, struct Arena *arena, int width, int height, int maxFrameQuads);
+void setRendererPartialRedraw(struct Renderer *renderer, bool enabled);
+void addRendererDamage(struct Renderer *renderer, int x, int y, int width, int height);
+
+// multi draw, batches are queued in one big vertex buffer instead of drawn as they are flushed, and everything
+// queued goes out as a single glMultiDrawElementsIndirect per pass once something gl needs changed (shader,
+// translucent blend, texture slots running out, a camera or palette upload, a render target, the end of the
+// frame). each queued draw carries its scissor as a clip rect the shader reads through the draw's base instance,
+// so scissor changes and full buffers stop costing draw calls. opaque quads of every queued batch are drawn
+// before any of the translucent ones. created up front like the frame cache
+void createRendererMultiDraw(struct Renderer *renderer, struct Arena *arena, int maxQuads, int maxDraws);
+void setRendererMultiDraw(struct Renderer *renderer, bool enabled);
+
+// sprite buffers, sprites that stay on the gpu between frames. each one is a record in a shader storage buffer
+// and the VERTEX_PULLING variant of default.glsl builds the corners of sprite gl_VertexID / 6 itself, so there is
+// no vertex or index data at all. records are written into the cpu copy and only the range that changed since the
+// last draw is uploaded, a buffer that did not change costs one draw call and nothing else. every sprite in a
+// buffer uses its texture, which is bound to the first texture slot for the draw
+struct GPUSprite {
+    vec2 position;
+    vec2 size;
+    vec2 origin;
+    float rotation;
+    
+    //already the z setRendererLayer turned the layer into
+    float layer;
+    
+    vec4 uv;
+    u32 colour;
+    u32 camera;
+    u32 blendMode;
+    float palette;
+};
+
+struct SpriteBuffer {
+    u32 buffer;
+    struct Texture texture;
+    
+    struct GPUSprite *sprites;
+    int count;
+    int capacity;
+    
+    //records [dirtyStart, dirtyEnd) have changed since the last upload
+    int dirtyStart;
+    int dirtyEnd;
+};
+
+struct SpriteBuffer createSpriteBuffer(struct Arena *arena, struct Texture texture, int capacity);
+void freeSpriteBuffer(struct SpriteBuffer *buffer);
+
+//same meaning as drawTextureEx, the record takes the renderer's current camera, blend mode and layer. the buffer
+//draws every sprite up to the highest index set
+void setSprite(struct Renderer *renderer, struct SpriteBuffer *buffer, int index, struct Sprite *sprite);
+void setSpriteColour(struct SpriteBuffer *buffer, int index, vec4 colour);
+
+//NOTE: drawn straight away in record order rather than batched, so the cameras have to be set already and every
+//sprite in the buffer has to blend the same way on the gpu as the renderer's current blend mode. the debug views
+//need the "VERTEX_PULLING DEBUG" variant as well, they show each draw as its own explicitly ended batch. without
+//it (NO_SHADER) the buffer is not drawn at all while one is on
+void drawSpriteBuffer(struct Renderer *renderer, struct SpriteBuffer *buffer, struct Shader vertexPullingShader,
+                      struct Shader vertexPullingDebugShader);
+
+//flushes and ends the frame, false when partial redraw found nothing to redraw and the swap can be skipped
+bool presentRenderer(struct Renderer *renderer);
+
+//flushes when the rectangle actually changes, coordinates are gl window coordinates (origin bottom left). inside
+//a render target they are the target's pixels at its full size, scaled down with the part setRenderTargetScale
+//leaves in use the same way the cameras are
+void setRendererScissor(struct Renderer *renderer, int x, int y, int width, int height);
+void clearRendererScissor(struct Renderer *renderer);
+
+enum FlushReason {
+    FLUSH_EXPLICIT,
+    FLUSH_BUFFER_FULL,
+    FLUSH_TEXTURE_SLOTS,
+    FLUSH_STATE_CHANGE,
+    FLUSH_REASON_COUNT
+};
+
+struct RendererStats {
+    u32 drawCalls;
+    u32 quads;
+    u32 opaqueQuads;
+    
+    //what ended each batch, indexed by enum FlushReason
+    u32 flushes[FLUSH_REASON_COUNT];
+    
+    //state changes that reached gl and the ones the state cache skipped
+    u32 glCalls;
+    u32 glCallsElided;
+};
+
+//returns what was counted since the last reset
+struct RendererStats resetRendererStats(struct Renderer *renderer);
+
+// debug views, drawn with a variant of the batch shader compiled with DEBUG (see default.glsl) in place of
+// whatever shader each batch uses. overdraw adds a little per fragment on a black clear so hot spots glow,
+// batches tints every batch in the frame a different colour and flush reasons tints each batch by what
+// ended it: green explicit, red buffer full, orange out of texture slots, blue state change. drawUpscaledTarget
+// shows the views of whatever was drawn into the target rather than its own quad
+enum RendererDebugMode {
+    RENDERER_DEBUG_NONE,
+    RENDERER_DEBUG_OVERDRAW,
+    RENDERER_DEBUG_BATCHES,
+    RENDERER_DEBUG_FLUSH_REASONS,
+    RENDERER_DEBUG_MODE_COUNT
+};
+
+void setRendererDebugMode(struct Renderer *renderer, enum RendererDebugMode mode, struct Shader debugShader);
+
 // image stuff
 struct Image {
     void *pixels;
@@ -39,12 +363,39 @@ struct Image {
     
     int bytesPerPixel;
     int pitch;
+    
+    //where the pixels live, heap allocated when this is NULL
+    struct Arena *arena;
 };
 
 struct Image loadImage(char *path);
 void freeImage(struct Image *image);
 
+// reads every file in one batch and decodes them on all cores as the reads complete, failed images are left empty.
+// with an arena the decoders work out of their own scratch arenas and only the final pixels end up in it
+void loadImages(char **paths, struct Image *images, int count, struct Arena *arena);
+
+// palettes, colours are RGBA8 in memory order
+#define PALETTE_SIZE 256
+#define RENDERER_MAX_PALETTES 64
+
+//NOTE: returns -1 once all RENDERER_MAX_PALETTES rows are in use, freeing an indexed texture gives its row back
+int createPalette(struct Renderer *renderer, u32 *colours, int colourCount);
+void freePalette(struct Renderer *renderer, int palette);
+void setPaletteColours(struct Renderer *renderer, int palette, u32 *colours, int colourCount);
+
+//NOTE: fails (returns an empty image) if the image uses more than PALETTE_SIZE colours
+struct Image loadIndexedImage(char *path, u32 *palette, int *colourCount);
+
+// precomputed mip levels live next to the base image as <name>.mip1.png, <name>.mip2.png, ...
+struct Texture createTextureFromImages(struct Image *levels, int levelCount, struct TextureSettings settings);
+
 struct Texture loadTexture(char *path);
+struct Texture loadTextureEx(char *path, struct TextureSettings settings);
+struct Texture loadIndexedTexture(struct Renderer *renderer, char *path);
+
+//with settings.generateMipmaps the precomputed levels are read in a second batch once the base images give their sizes
+void loadTextures(char **paths, struct Texture *textures, int count, struct TextureSettings settings);
 void freeTexture(struct Texture *texture);
 
 #endif
\ No newline at end of file